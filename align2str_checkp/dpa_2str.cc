@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
 #include <malloc.h>
 
 using namespace std;
@@ -51,11 +52,17 @@ void dispArray(int D[], char A[], char B[])
   cout << endl;
 }
 
-#define P(i,j) ((i)*(m+1)+(j))	// P is a macro to access 1 dimensional D as
+#define P(i,j) ((i)*(m+1L)+(j))	// P is a macro to access 1 dimensional D as
 				// if it were 2 dimensional
 
-// dispAlignment - Backtraces on the D array to find the actual alignment.
-void dispAlignment(int D[], char A[], char B[])
+// The direction each cell was reached from is packed 2 bits to a cell
+// (4 cells to a byte).  That is all the backtrace needs.
+enum {MATCH=0, INSERT=1, DELETE=2};
+#define GETDIR(Dir,p)   ((Dir[(p)>>2] >> (((p)&3)*2)) & 3)
+#define SETDIR(Dir,p,d) (Dir[(p)>>2] |= (d) << (((p)&3)*2))
+
+// dispAlignment - Backtraces on the Dir array to find the actual alignment.
+void dispAlignment(unsigned char Dir[], char A[], char B[])
 {
   int n,m,i,j,pos;
   char chars[2*MAXSTRING],ch1,ch2;
@@ -65,8 +72,9 @@ void dispAlignment(int D[], char A[], char B[])
   j=m;
   pos=0;
   // Work out alignment in reverse order, then display in correct order
-  // Choice of alignment out of all the optimal alignments makes choice in this
-  // order: Match, Insert, Delete   (on the reverse alignment)
+  // Choice of alignment out of all the optimal alignments was made when Dir
+  // was filled in, in this order: Match, Insert, Delete   (on the reverse
+  // alignment)
   while (i!=0 || j!=0) {
     ch1 = ch2 = '-';
     if (i==0) {			// Left column, must be insert
@@ -76,26 +84,21 @@ void dispAlignment(int D[], char A[], char B[])
       ch1 = A[i-1];
       i--;
     } else {
-      int matchCost, insertCost, deleteCost;
-      matchCost  = D[P(i-1,j-1)] + (A[i-1]==B[j-1] ? 0 : 1);
-      insertCost = D[P(i,j-1)] + 1;
-      deleteCost = D[P(i-1,j)] + 1;
-      if (matchCost <= insertCost) {
-	if (matchCost <= deleteCost) { 
-	  ch1 = A[i-1];		// A match or mismatch
-	  ch2 = B[j-1];
-	  i--;
-	  j--;
-	} else {
-	  ch1 = A[i-1];		// A Delete
-	  i--;
-	}
-      } else if (insertCost <= deleteCost) {
+      switch (GETDIR(Dir,P(i,j))) {
+      case MATCH:
+	ch1 = A[i-1];		// A match or mismatch
+	ch2 = B[j-1];
+	i--;
+	j--;
+	break;
+      case INSERT:
 	ch2 = B[j-1];		// An Insert
 	j--;
-      } else {
+	break;
+      case DELETE:
 	ch1 = A[i-1];		// A Delete
 	i--;
+	break;
       }
     }
     chars[pos++] = ch1;
@@ -110,7 +113,8 @@ void dispAlignment(int D[], char A[], char B[])
 
 long loopCount;
 
-// doDpa - Does standard DPA on 2 strings A and B.
+// doDpa - Does standard DPA on 2 strings A and B.  Only two rows of D are
+// kept, the alignment is recovered from the packed directions.
 int doDpa(char A[], char B[])
 {
   int res,m,n;
@@ -124,35 +128,45 @@ int doDpa(char A[], char B[])
     B[i] = toupper(B[i]);
   {
     int *Data;
-    Data = (int *)malloc(sizeof(int)*(n+1)*(m+1));
-    if (!Data) {fprintf(stderr,"Unable to malloc memory\n"); exit(-1); }
+    unsigned char *Dir;
+    Data = (int *)malloc(sizeof(int)*2*(m+1));
+    Dir = (unsigned char *)calloc(((n+1)*(m+1L)+3)/4, 1);
+    if (!Data || !Dir) {fprintf(stderr,"Unable to malloc memory\n"); exit(-1); }
 
-#define D(x,y) Data[(x)*(m+1)+y]
+#define D(x,y) Data[((x)%2)*(m+1)+y]
     
     D(0,0) = 0;		// Initialize D
-    for (int i=1;i<=n;i++)
-      D(i,0) = i;
     for (int j=1;j<=m;j++)
       D(0,j) = j;
     
     // Calculate the D array for the edit distance
-    for (int i=1;i<=n;i++)
+    for (int i=1;i<=n;i++) {
+      D(i,0) = i;
       for (int j=1;j<=m;j++) {
+	int matchCost, insertCost, deleteCost;
         loopCount++;
-	D(i,j) = MIN3(
-	  D(i-1,j-1) + (A[i-1]==B[j-1] ? 0 : 1), // Match or change
-	  D(i,j-1) + 1,	// Insert
-	  D(i-1,j) + 1);	// Delete
+	matchCost  = D(i-1,j-1) + (A[i-1]==B[j-1] ? 0 : 1); // Match or change
+	insertCost = D(i,j-1) + 1;	// Insert
+	deleteCost = D(i-1,j) + 1;	// Delete
+	if (matchCost <= insertCost && matchCost <= deleteCost) {
+	  D(i,j) = matchCost;
+	  SETDIR(Dir,P(i,j),MATCH);
+	} else if (insertCost <= deleteCost) {
+	  D(i,j) = insertCost;
+	  SETDIR(Dir,P(i,j),INSERT);
+	} else {
+	  D(i,j) = deleteCost;
+	  SETDIR(Dir,P(i,j),DELETE);
+	}
       }
+    }
     
-    // Display the DPA array
-//    dispArray((int*)D,A,B);
-
     // Display the alignment
-    dispAlignment(Data,A,B);
+    dispAlignment(Dir,A,B);
     
     res = D(n,m);		// Store edit distance
     free(Data);
+    free(Dir);
   }
   return res;
 }
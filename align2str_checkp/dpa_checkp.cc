@@ -20,6 +20,8 @@
 
 // DPA for 2 string alignment with checkpointing to find alignment.
 // Time complexity=O(n*n)    Space complexity=O(n)
+// When there are few matching pairs of characters a pass can instead be
+// done by sparse DP over just the match points, see sparsePass().
 // Constant costs
 //      match : 0
 //      change,indel : 1
@@ -28,12 +30,21 @@
 #include <ctype.h>
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 
 using namespace std;
 
 #define PRINT
 
 #define MAXSTRING 20000		// Maximum size for reading in a string
+#define BLOCK_SIZE 32		// Recursion stops at blocks this size
+#define BIG        1000000000	// Cost of a cell outside the band
+#define SPARSE_COST 2		// Work of a match point in a sparse pass, per
+				// log2(points)*log2(diagonals), in thirds of
+				// a cell of a dense pass
+#define SPARSE_SPACE 4		// Most match points a sparse pass may hold, per
+				// char of the two strings (keeps space O(n))
 
 #define MIN3(x,y,z) ((x)<(y) ? ((x)<(z) ? (x) : (z)) : ((y)<(z) ? (y) : (z)))
 #define MIN_INDEX3(x,y,z) ((x)<=(y) ? ((x)<=(z) ? 0 : 2) : ((y)<=(z) ? 1 : 2))
@@ -43,17 +54,481 @@ int alignPos = 0;
 
 long loopCount;
 
+// Pruning (-p).  A cell whose edit distance plus a lower bound on the rest
+// of the path is more than the pass allows can not be on an optimal path,
+// so it is set to BIG.  pruneCount counts the cells done and then pruned,
+// skipCount those never done because no path could reach them.
+int prune = 0;
+long pruneCount, skipCount;
+
+// Sparse passes.  With SPARSE_AUTO a pass is done sparse when that looks
+// cheaper than the dense pass (or band) it replaces.  Either way a pass
+// with more than SPARSE_SPACE*(n+m) match points is done dense, as the
+// sparse pass needs memory for each of them.
+#define SPARSE_NEVER  0
+#define SPARSE_AUTO   1
+#define SPARSE_ALWAYS 2
+int sparseMode = SPARSE_AUTO;
+int sparsePasses;
+long sparseCount;		// Match points done in sparse passes
+
 struct crossingType {
   int splitPoint,exitPoint;
+  int splitCost;		// Edit distance at the split point
+};
+
+struct cellType {
+  int D;			// Edit distance to this cell
+  struct crossingType crossing;	// Where the path to this cell crosses
+};				// the check-point row.
+
+// The DPA matrix is done in blocks, so only the boundary of the blocks is
+// kept.  hrow holds the last row done for each column, and vcol the last
+// column done for each row.  Both should be sized dynamically. But I am too
+// lazy.
+struct cellType hrow[MAXSTRING+1];
+struct cellType vcol[MAXSTRING+1];
+
+// Info about the current pass needed in every block.  Only diagonals
+// (i-j) lo..hi of the pass are done, any other cell costs BIG.  The pass
+// is n by m, and no path costing more than 'bound' is wanted.
+struct passType {
+  char *A, *B;
+  int a0, b0;
+  int splitRow;
+  int lo, hi;
+  int n, m, bound;
 };
 
-struct crossingType crossing[2][MAXSTRING+1];
-int D[2][MAXSTRING+1];		// D is the table for alignment.
-				// D should be sized dynamically. But I am too
-				// lazy.
+// pruned - true if a path through cell (i,j) of the pass, which has edit
+// distance D, must cost more than p.bound.  The rest of the path has to get
+// from diagonal i-j to diagonal n-m, so has at least that many indels.
+inline int pruned(const struct passType &p, int i, int j, int D)
+{
+  return D + abs((p.n-i) - (p.m-j)) > p.bound;
+}
+
+// setBand - the band of diagonals a path costing at most 'cost' can use,
+// in an n by m pass.  Each step off the diagonal costs 1, and the path
+// has to get from diagonal 0 to diagonal n-m.
+void setBand(struct passType &p, int n, int m, int cost)
+{
+  int d = n-m, spare = (cost - abs(d))/2;
+  p.lo = (d<0 ? d : 0) - spare;
+  p.hi = (d>0 ? d : 0) + spare;
+}
+
+// calcBlock - Do the rows i0..i1 and columns j0..j1 of the current pass,
+// updating hrow and vcol.  'corner' is the cell above and left of the block.
+void calcBlock(const struct passType &p, int i0, int i1, int j0, int j1,
+	       const struct cellType &corner)
+{
+  struct cellType rows[2][BLOCK_SIZE+1]; // [0] is the column to the left
+  struct cellType *prev = rows[0], *cur = rows[1];
+  int w = j1-j0+1;
+  int prevLast = -1;		// Last c of prev[] below BIG
+
+  prev[0] = corner;
+  for (int c=1;c<=w;c++)
+    prev[c] = hrow[j0+c-1];
+  for (int c=0;c<=w;c++)
+    if (prev[c].D < BIG)
+      prevLast = c;
+
+  for (int i=i0;i<=i1;i++) {
+    // Columns of this row inside the band
+    int cLo = i-p.hi-j0+1, cHi = i-p.lo-j0+1;
+    if (cLo<1) cLo = 1;
+    if (cLo>w+1) cLo = w+1;
+    if (cHi>w) cHi = w;
+    if (cHi<cLo-1) cHi = cLo-1;
+
+    cur[0] = vcol[i];
+    for (int c=1;c<cLo;c++)
+      cur[c].D = BIG;
+    for (int c=cHi+1;c<=w;c++)
+      cur[c].D = BIG;
+
+    // Skip the cells no path reaches, those left of anything below BIG in
+    // this row or the last ...
+    int c = cLo, last = (cur[0].D < BIG ? 0 : -1);
+    if (prune && cur[c-1].D >= BIG)
+      for (;c<=cHi && prev[c-1].D >= BIG && prev[c].D >= BIG;c++) {
+	cur[c].D = BIG;
+	skipCount++;
+      }
+
+    for (;c<=cHi;c++) {
+      int j = j0+c-1;
+      int matchCost, insertCost, deleteCost;
+
+      // ... and those right of them
+      if (prune && c-1 > prevLast && cur[c-1].D >= BIG) {
+	for (;c<=cHi;c++) {
+	  cur[c].D = BIG;
+	  skipCount++;
+	}
+	break;
+      }
+
+      loopCount++;
+      
+      matchCost  = prev[c-1].D + (p.A[i-1+(p.a0)]==p.B[j-1+(p.b0)] ? 0 : 1);
+      insertCost = cur[c-1].D + 1;
+      deleteCost = prev[c].D + 1;
+      
+      switch (MIN_INDEX3(matchCost, insertCost, deleteCost)) {
+      case 0:			// Match or mismatch
+	cur[c].D = matchCost;
+	cur[c].crossing = prev[c-1].crossing;
+	if (i==p.splitRow+1)
+	  cur[c].crossing.exitPoint = j;
+	break;
+      case 1:			// Insert
+	cur[c].D = insertCost;
+	cur[c].crossing = cur[c-1].crossing;
+	// Note: no exit dir recorded if it was an insert
+	//       and crossing info comes from same row.
+	break;
+      case 2:			// Delete
+	cur[c].D = deleteCost;
+	cur[c].crossing = prev[c].crossing;
+	if (i==p.splitRow+1)
+	  cur[c].crossing.exitPoint = j;
+	break;
+      }
+
+      if (prune && pruned(p, i, j, cur[c].D)) {
+	cur[c].D = BIG;
+	pruneCount++;
+      } else
+	last = c;
+
+      // Set up check point if it is half way
+      if (i==p.splitRow) {
+	cur[c].crossing.splitPoint = j;
+	cur[c].crossing.exitPoint = j-1; // Assume exit is Insert until
+				         // determined on next pass
+	cur[c].crossing.splitCost = cur[c].D;
+      }
+    } // end for c
+    vcol[i] = cur[w];
+    prevLast = last;
+    struct cellType *t = prev; prev = cur; cur = t;
+  } // end for i
+
+  for (int c=1;c<=w;c++)
+    hrow[j0+c-1] = prev[c];
+}
+
+// doPass - Cache-oblivious traversal of the DPA matrix.  The longer side is
+// halved until the block is small, so at every scale the block being worked
+// on (and its boundary) fits in the cache.
+void doPass(const struct passType &p, int i0, int i1, int j0, int j1,
+	    const struct cellType &corner)
+{
+  if (i1-j0 < p.lo || i0-j1 > p.hi) {	// All outside the band
+    for (int j=j0;j<=j1;j++)
+      hrow[j].D = BIG;
+    for (int i=i0;i<=i1;i++)
+      vcol[i].D = BIG;
+  } else if (i1-i0 < BLOCK_SIZE && j1-j0 < BLOCK_SIZE) {
+    calcBlock(p, i0, i1, j0, j1, corner);
+  } else if (i1-i0 >= j1-j0) {
+    int mid = (i0+i1)/2;
+    struct cellType corner2 = vcol[mid];	// Save before top half is done
+    doPass(p, i0, mid, j0, j1, corner);
+    doPass(p, mid+1, i1, j0, j1, corner2);
+  } else {
+    int mid = (j0+j1)/2;
+    struct cellType corner2 = hrow[mid];	// Save before left half is done
+    doPass(p, i0, i1, j0, mid, corner);
+    doPass(p, i0, i1, mid+1, j1, corner2);
+  }
+}
+
+// Sparse DP (D. Eppstein, Z. Galil, R. Giancarlo and G. F. Italiano,
+// "Sparse Dynamic Programming I: Linear Cost Functions", J. ACM, 1992,
+// 39:3, pp 519-545).  A sparse pass only looks at the match points, the
+// (i,j) with A[i]==B[j] (from 1).  The best path to a match point q comes
+// from some match point p up and left of it, with no matches between.
+// Getting from the cell after p, (ip,jp), to the cell before q,
+// (iq-1,jq-1), costs the larger of di=iq-1-ip and dj=jq-1-jp (a mismatch
+// for each step both ways, and an indel for the rest).  Which is larger
+// only depends on the diagonals of p and q, so
+//   D(q) = min( min D(p)-ip over p with jp<jq, ip-jp <= iq-jq  + iq-1,
+//               min D(p)-jp over p with ip<iq, ip-jp >  iq-jq  + jq-1 )
+// (in each the other of ip<iq and jp<jq follows).  The start (0,0) and
+// the end (n+1,m+1) are match points too.  Each minimum is over points
+// below two bounds, so they are done by divide and conquer over the
+// points in row order: the first half are finished, each point of the
+// second half gets the best of them from a Fenwick tree over the
+// diagonals, then the second half is done.  The points are also kept in
+// column order, split on the way down and merged on the way up, so no
+// sorting is needed.  For r match points this is O(r*log(r)*log(n)) time
+// and O(r) space, so it wins when there are few matches (a big alphabet,
+// or very different strings).
+//
+// The check-pointing is the same as for a dense pass.  The path found
+// is followed back from the end to where it crosses the split row, and
+// doDpa() recurses on the two halves as usual (each choosing its own
+// kind of pass).
+
+struct matchPoint {
+  int i, j;			// In the pass, from 1
+  int D;			// Edit distance to it
+  int pred;			// Match point the best path comes from
+};
+
+struct matchPoint *pts;		// The match points of a sparse pass, by row
+int *byCol;			// Their indexes, in column order
+int *colScratch;
+
+// Where each char is in B, to find match points.  Those of char c are
+// occPos[occStart[c]..occStart[c+1]), in order.
+int occStart[257];
+int occPos[MAXSTRING];
+
+// Two Fenwick trees of (min) D(p)-ip and D(p)-jp, indexed by diagonal,
+// with the point each came from.  Both are BIG between uses.
+struct fenType {
+  int val, pt;
+} fen[2][2*MAXSTRING+4];
+
+// buildOccurrences - fill in occStart and occPos for B, and clear the
+// Fenwick trees
+void buildOccurrences(char B[])
+{
+  int count[257], c;
+
+  for (c=0;c<257;c++)
+    count[c] = 0;
+  for (int j=0;B[j];j++)
+    count[(unsigned char)B[j]+1]++;
+  occStart[0] = 0;
+  for (c=1;c<257;c++)
+    occStart[c] = occStart[c-1] + count[c];
+  for (c=0;c<256;c++)
+    count[c] = occStart[c];
+  for (int j=0;B[j];j++)
+    occPos[count[(unsigned char)B[j]]++] = j;
+
+  for (int t=0;t<2;t++)
+    for (int k=0;k<2*MAXSTRING+4;k++)
+      fen[t][k].val = BIG;
+}
+
+// countMatches - the match points of A[a0..a0+n) and B[b0..b0+m)
+long countMatches(char A[], int a0, int b0, int n, int m)
+{
+  long r = 0;
+
+  for (int i=a0;i<a0+n;i++) {
+    unsigned char c = A[i];
+    r += std::lower_bound(occPos+occStart[c], occPos+occStart[c+1], b0+m) -
+         std::lower_bound(occPos+occStart[c], occPos+occStart[c+1], b0);
+  }
+  return r;
+}
+
+// sparseWork - the work of a sparse pass over r match points of an n*m
+// block, in cells of a dense pass
+long sparseWork(long r, int n, int m)
+{
+  int lgR = 1, lgD = 1;
+
+  while ((1L<<lgR) < r+2)
+    lgR++;
+  while ((1L<<lgD) < n+m+3)
+    lgD++;
+  return SPARSE_COST * (r+2) * lgR * lgD / 3;
+}
+
+// fenAdd - offer v, from point pt, at index k (from 1) of tree t
+inline void fenAdd(int t, int size, int k, int v, int pt)
+{
+  for (;k<=size;k+=k&-k)
+    if (v < fen[t][k].val) {
+      fen[t][k].val = v;
+      fen[t][k].pt = pt;
+    }
+}
+
+// fenBest - the least value at indexes 1..k of tree t, and its point
+inline int fenBest(int t, int k, int &pt)
+{
+  int best = BIG;
+
+  for (pt=-1;k>0;k-=k&-k)
+    if (fen[t][k].val < best) {
+      best = fen[t][k].val;
+      pt = fen[t][k].pt;
+    }
+  return best;
+}
 
-// doDpa -
-int doDpa(char A[], char B[], int a0, int b0, int a1, int b1)
+inline void fenClear(int t, int size, int k)
+{
+  for (;k<=size && fen[t][k].val<BIG;k+=k&-k)
+    fen[t][k].val = BIG;
+}
+
+// offer - a path to q from p costing D
+inline void offer(int q, int p, int D)
+{
+  if (D < pts[q].D) {
+    pts[q].D = D;
+    pts[q].pred = p;
+  }
+}
+
+// sparseJoin - give each point of pts[mid..r) its best path from the
+// (finished) points of pts[l..mid).  byCol[l..mid) and byCol[mid..r)
+// are each in column order.  Diagonal d has index d+m+2 in tree 0, and
+// is reversed in tree 1 so that both are prefix minimums.
+void sparseJoin(int l, int mid, int r, int n, int m)
+{
+  int size = n+m+3, a, x, pt, v;
+
+  // Paths costing di, in column order
+  for (a=l, x=mid;x<r;x++) {
+    int q = byCol[x];
+    for (;a<mid && pts[byCol[a]].j < pts[q].j;a++) {
+      int p = byCol[a];
+      fenAdd(0, size, pts[p].i-pts[p].j+m+2, pts[p].D-pts[p].i, p);
+    }
+    v = fenBest(0, pts[q].i-pts[q].j+m+2, pt);
+    if (v < BIG)
+      offer(q, pt, v+pts[q].i-1);
+  }
+  for (x=l;x<a;x++)
+    fenClear(0, size, pts[byCol[x]].i-pts[byCol[x]].j+m+2);
+
+  // Paths costing dj, in row order
+  for (a=l, x=mid;x<r;x++) {
+    for (;a<mid && pts[a].i < pts[x].i;a++)
+      fenAdd(1, size, size+1-(pts[a].i-pts[a].j+m+2), pts[a].D-pts[a].j, a);
+    v = fenBest(1, size-(pts[x].i-pts[x].j+m+2), pt);
+    if (v < BIG)
+      offer(x, pt, v+pts[x].j-1);
+  }
+  for (x=l;x<a;x++)
+    fenClear(1, size, size+1-(pts[x].i-pts[x].j+m+2));
+}
+
+// sparseSolve - finish the points pts[l..r).  Paths into them from
+// points before l are already offered.  byCol[l..r) holds l..r-1 in
+// column order, before and after.
+void sparseSolve(int l, int r, int n, int m)
+{
+  if (r-l <= BLOCK_SIZE) {	// Small enough to try every pair
+    for (int q=l+1;q<r;q++)
+      for (int p=l;p<q;p++)
+	if (pts[p].i < pts[q].i && pts[p].j < pts[q].j)
+	  offer(q, p, pts[p].D + std::max(pts[q].i-1-pts[p].i,
+					  pts[q].j-1-pts[p].j));
+    return;
+  }
+
+  int mid = (l+r)/2, a, b, x;
+
+  // Split the column order into the two halves
+  for (a=l, b=mid, x=l;x<r;x++)
+    if (byCol[x] < mid)
+      colScratch[a++] = byCol[x];
+    else
+      colScratch[b++] = byCol[x];
+  memcpy(byCol+l, colScratch+l, (r-l)*sizeof(int));
+
+  sparseSolve(l, mid, n, m);
+  sparseJoin(l, mid, r, n, m);
+  sparseSolve(mid, r, n, m);
+
+  // Merge them back
+  for (a=l, b=mid, x=l;x<r;x++)
+    if (b==r || (a<mid && pts[byCol[a]].j <= pts[byCol[b]].j))
+      colScratch[x] = byCol[a++];
+    else
+      colScratch[x] = byCol[b++];
+  memcpy(byCol+l, colScratch+l, (r-l)*sizeof(int));
+}
+
+// sparsePass - the pass of A[a0..a0+n) and B[b0..b0+m) as sparse DP,
+// over its r match points.  Returns the edit distance, and sets
+// 'crossing' to where the path crosses from splitRow to the next row,
+// as a dense pass would (see calcBlock()).
+int sparsePass(char A[], int a0, int b0, int n, int m, int splitRow,
+	       long r, struct crossingType &crossing)
+{
+  int k = 0, p, q;
+
+  pts = new struct matchPoint[r+2];
+  byCol = new int[r+2];
+  colScratch = new int[r+2];
+
+  pts[k].i = pts[k].j = pts[k].D = 0;
+  pts[k++].pred = -1;
+  for (int i=1;i<=n;i++) {
+    unsigned char c = A[a0+i-1];
+    int *o = std::lower_bound(occPos+occStart[c], occPos+occStart[c+1], b0);
+    for (;o<occPos+occStart[c+1] && *o<b0+m;o++) {
+      pts[k].i = i;
+      pts[k].j = *o-b0+1;
+      pts[k].D = BIG;
+      pts[k++].pred = -1;
+    }
+  }
+  pts[k].i = n+1;
+  pts[k].j = m+1;
+  pts[k].D = BIG;
+  pts[k++].pred = -1;
+
+  // The column order, by counting sort
+  int *colStart = new int[m+3];
+  for (q=0;q<m+3;q++)
+    colStart[q] = 0;
+  for (q=0;q<k;q++)
+    colStart[pts[q].j+1]++;
+  for (q=1;q<m+3;q++)
+    colStart[q] += colStart[q-1];
+  for (q=0;q<k;q++)
+    byCol[colStart[pts[q].j]++] = q;
+  delete[] colStart;
+
+  sparseSolve(0, k, n, m);
+  sparsePasses++;
+  sparseCount += k;
+
+  // Back along the path to the step from p to q that crosses splitRow
+  for (q=k-1, p=pts[q].pred;pts[p].i > splitRow;q=p, p=pts[q].pred) ;
+
+  int di = pts[q].i-1-pts[p].i, dj = pts[q].j-1-pts[p].j;
+  int t = splitRow-pts[p].i, diagSteps = std::min(di, dj);
+  if (t==di) {			// The match into q
+    crossing.splitPoint = pts[q].j-1;
+    crossing.exitPoint = pts[q].j;
+    crossing.splitCost = pts[q].D;
+  } else if (t<diagSteps) {	// A mismatch
+    crossing.splitPoint = pts[p].j+t;
+    crossing.exitPoint = pts[p].j+t+1;
+    crossing.splitCost = pts[p].D+t;
+  } else {			// A delete
+    crossing.splitPoint = crossing.exitPoint = pts[p].j+diagSteps;
+    crossing.splitCost = pts[p].D+t;
+  }
+
+  int editDistance = pts[k-1].D;
+  delete[] pts;
+  delete[] byCol;
+  delete[] colScratch;
+  return editDistance;
+}
+
+// doDpa - align A[a0..a1) with B[b0..b1).  'cost' is their edit distance,
+// so only the band of diagonals that cost allows is done.  At the top level
+// it is not known (-1), and the band is doubled until the edit distance
+// found fits in it (as in Ukkonen's algorithm).
+int doDpa(char A[], char B[], int a0, int b0, int a1, int b1, int cost)
 {
   int splitRow, n=a1-a0, m=b1-b0;
 
@@ -74,67 +549,61 @@ int doDpa(char A[], char B[], int a0, int b0, int a1, int b1)
   }
   
   splitRow = n/2;
-  D[0][0] = 0;			// Initialize D
-  for (int j=0;j<=m;j++)
-    D[0][j] = j;
-  
-  for (int k=0;k<=m;k++) {	// Initialise crossing info. (only used if 
-    crossing[0][k].splitPoint = k; // splitRow == 0).
-    crossing[0][k].exitPoint = k-1;
-  }
-  
-  // Calculate the D array for the edit distance
-  for (int i=1;i<=n;i++) {
-    D[i%2][0] = i;
-    crossing[i%2][0].splitPoint = 0; crossing[i%2][0].exitPoint = 0;
-    for (int j=1;j<=m;j++) {
-      int matchCost, insertCost, deleteCost;
+  struct passType p = {A, B, a0, b0, splitRow};
+  int band = (cost<0 ? abs(n-m)+2 : cost);
+  long matches = (sparseMode==SPARSE_NEVER ? 0 : countMatches(A, a0, b0, n, m));
+  struct crossingType crossing;
+  int editDistance;
+
+  p.n = n;
+  p.m = m;
+  while (1) {
+    setBand(p, n, m, band);
+    p.bound = band;
+
+    // Would a sparse pass fit, and be less work than this band?
+    if (matches <= (long)SPARSE_SPACE*(n+m) &&
+	(sparseMode==SPARSE_ALWAYS ||
+	 (sparseMode==SPARSE_AUTO &&
+	  sparseWork(matches, n, m) < (long)n*std::min(m, p.hi-p.lo+1)))) {
+      editDistance = sparsePass(A, a0, b0, n, m, splitRow, matches, crossing);
+      break;
+    }
 
-      loopCount++;
-      
-      matchCost  = D[(i-1)%2][j-1] + (A[i-1+(a0)]==B[j-1+(b0)] ? 0 : 1);
-      insertCost = D[i%2][j-1] + 1;
-      deleteCost = D[(i-1)%2][j] + 1;
-      
-      switch (MIN_INDEX3(matchCost, insertCost, deleteCost)) {
-      case 0:			// Match or mismatch
-	D[i%2][j] = matchCost;
-	crossing[i%2][j] = crossing[(i-1)%2][j-1];
-	if (i==splitRow+1)
-	  crossing[i%2][j].exitPoint = j;
-	break;
-      case 1:			// Insert
-	D[i%2][j] = insertCost;
-	crossing[i%2][j] = crossing[i%2][j-1];
-	// Note: no exit dir recorded if it was an insert
-	//       and crossing info comes from same row.
-	break;
-      case 2:			// Delete
-	D[i%2][j] = deleteCost;
-	crossing[i%2][j] = crossing[(i-1)%2][j];
-	if (i==splitRow+1)
-	  crossing[i%2][j].exitPoint = j;
-	break;
-      }
-    } // end for j
-
-    // Set up check point if it is half way
-    if (i==splitRow) {
-      for (int k=0;k<=m;k++) {
-	crossing[i%2][k].splitPoint = k;
-	crossing[i%2][k].exitPoint = k-1; // Assume exit is Insert until
-				          // determined on next pass
-      }
+    for (int j=0;j<=m;j++) {	// Initialize row 0
+      hrow[j].D = (prune && pruned(p, 0, j, j)) ? BIG : j;
+      hrow[j].crossing.splitPoint = j; // Initialise crossing info. (only used
+      hrow[j].crossing.exitPoint = j-1; // if splitRow == 0).
+      hrow[j].crossing.splitCost = j;
     }
-    
-  } // end for i
+    for (int i=1;i<=n;i++) {	// and column 0
+      vcol[i].D = (prune && pruned(p, i, 0, i)) ? BIG : i;
+      vcol[i].crossing.splitPoint = 0;
+      vcol[i].crossing.exitPoint = (i==splitRow) ? -1 : 0;
+      vcol[i].crossing.splitCost = splitRow;
+    }
+  
+    // Calculate the D array for the edit distance
+    doPass(p, 1, n, 1, m, hrow[0]);
+
+    // Any path that costs no more than this is inside the band (and
+    // is not pruned)
+    if (hrow[m].D <= band) {
+      editDistance = hrow[m].D;	// Save the actual edit distance.
+      crossing = hrow[m].crossing;
+      break;
+    }
+    band *= 2;
+  }
 
-  int editDistance = D[n%2][m];	// Save the actual edit distance.
-  int splitColumn = crossing[n%2][m].splitPoint; // Where to finish top half
-  int startPoint  = crossing[n%2][m].exitPoint;  // Where to start bottom half
+  int splitColumn = crossing.splitPoint; // Where to finish top half
+  int startPoint  = crossing.exitPoint;  // Where to start bottom half
+  int topCost     = crossing.splitCost;
+  int stepCost    = (splitColumn==startPoint ||
+		     A[a0+splitRow]!=B[b0+splitColumn]) ? 1 : 0;
   
 				// Recurse for top half
-  doDpa(A, B, a0, b0, a0+splitRow,  b0+splitColumn);
+  doDpa(A, B, a0, b0, a0+splitRow,  b0+splitColumn, topCost);
   
 				// Now store alignment info. It was either a
 				// delete or a match (mismatch), cause it had
@@ -142,7 +611,8 @@ int doDpa(char A[], char B[], int a0, int b0, int a1, int b1)
   alignment[alignPos++] = (splitColumn==startPoint) ? 2 : 0;
 
 				// Recurse for bottom half
-  doDpa(A, B, a0+splitRow+1, b0+startPoint, a1, b1);
+  doDpa(A, B, a0+splitRow+1, b0+startPoint, a1, b1,
+	editDistance-topCost-stepCost);
     
 //  cout << "Edit distance = " << D[n%2][m] << endl;
 //  cout << "Split point = " << splitRow << "," << splitColumn << endl;
@@ -151,7 +621,7 @@ int doDpa(char A[], char B[], int a0, int b0, int a1, int b1)
   return editDistance;		// Return edit distance
 }
 
-void msg() {
+void msg(char *prog) {
   cout << "Copyright (C) David Powell <david@drp.id.au>" << endl;
   cout << "  This program comes with ABSOLUTELY NO WARRANTY; and is provided" << endl;
   cout << "  under the GNU Public License v2, for details see file COPYRIGHT" << endl << endl;
@@ -159,12 +629,31 @@ void msg() {
   cout << "This program calculates the edit distance between two strings, and" << endl;
   cout << "displays an optimal alignment.  This program uses a basic DPA with" << endl;
   cout << "check-pointing(1) to recover the alignment, and has time complexity O(n*n)," << endl;
-  cout << "and space complexity O(n)" << endl;
+  cout << "and space complexity O(n).  Each pass only does the band of diagonals its" << endl;
+  cout << "edit distance d allows, so on similar strings the time is O(n*d).  When" << endl;
+  cout << "there are few matching pairs of characters a pass is instead done by sparse" << endl;
+  cout << "DP(2) over the r match points, in O(r*log(r)*log(n)) time.  Only a pass" << endl;
+  cout << "with r at most " << SPARSE_SPACE << "*(n+m) can be sparse, so the space stays O(n)" << endl;
   cout << endl;
   cout << "1:  D. R. Powell, L. Allison and T. I. Dix," << endl;
   cout << "    \"A Versatile Divide and Conquer Technique for Optimal String Alignment\"," << endl;
   cout << "    Information Processing Letters, 1999, 70:3, pp 127-139" << endl;
 
+  cout << endl;
+
+  cout << "2:  D. Eppstein, Z. Galil, R. Giancarlo and G. F. Italiano," << endl;
+  cout << "    \"Sparse Dynamic Programming I: Linear Cost Functions\"," << endl;
+  cout << "    Journal of the ACM, 1992, 39:3, pp 519-545" << endl;
+
+  cout << endl << endl;
+
+  cout << "Usage: " << prog << " [-p] [-s | -d]" << endl;
+  cout << "  -p  prune the cells whose distance, plus the indels still needed to" << endl;
+  cout << "      reach the end, is more than the pass allows" << endl;
+  cout << "  -s  do every pass by sparse DP over the match points only, unless" << endl;
+  cout << "      it has too many of them (more than " << SPARSE_SPACE << "*(n+m)) to keep" << endl;
+  cout << "  -d  never do a sparse pass.  By default a pass is done sparse when" << endl;
+  cout << "      there are few enough matches for that to be less work" << endl;
   cout << endl << endl;
 }
 
@@ -173,7 +662,16 @@ int main(int argc, char *argv[])
   char A[MAXSTRING],B[MAXSTRING];
   int res;
 
-  msg();
+  msg(argv[0]);
+
+  for (int a=1;a<argc;a++) {
+    if (strcmp(argv[a],"-p")==0)
+      prune = 1;
+    else if (strcmp(argv[a],"-s")==0)
+      sparseMode = SPARSE_ALWAYS;
+    else if (strcmp(argv[a],"-d")==0)
+      sparseMode = SPARSE_NEVER;
+  }
 
   cout << "Enter string A : ";
   cin >> A;
@@ -186,8 +684,12 @@ int main(int argc, char *argv[])
   for (int i=0;B[i];i++)
     B[i] = toupper(B[i]);
 
-  loopCount = 0;
-  res = doDpa(A, B, 0, 0, strlen(A), strlen(B));
+  buildOccurrences(B);
+
+  loopCount = pruneCount = skipCount = 0;
+  sparsePasses = 0;
+  sparseCount = 0;
+  res = doDpa(A, B, 0, 0, strlen(A), strlen(B), -1);
 
 #ifdef PRINT
   for (int i=0,j=0,pos=0;pos<alignPos;pos++) {
@@ -212,6 +714,11 @@ int main(int argc, char *argv[])
   cout << endl;
   cout << "Edit distance = " << res << endl;
   cout << "Loop Counter = " << loopCount << endl;
+  if (sparsePasses)
+    printf("Sparse passes = %d   Match points = %ld\n", sparsePasses, sparseCount);
+  if (prune)
+    printf("Pruned = %ld   Skipped = %ld   (%.1f%% of the band not done)\n",
+	   pruneCount, skipCount, loopCount+skipCount ? 100.0*skipCount/(loopCount+skipCount) : 0.0);
 
   return 0;
 }
@@ -26,6 +26,7 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <malloc.h>
 #include "ukk_noalign.h"
 
@@ -34,14 +35,14 @@ using namespace std;
 
 #define MAXSTRING 20000		// Maximum size for reading in a string
 
-void msg() {
+void msg(char *prog) {
   cout << "Copyright (C) David Powell <david@drp.id.au>" << endl;
   cout << "  This program comes with ABSOLUTELY NO WARRANTY; and is provided" << endl;
   cout << "  under the GNU Public License v2, for details see file COPYRIGHT" << endl << endl;
 
   cout << "This program calculates the edit distance between two strings, _but_ does not" << endl;
   cout << "recover an alignment.  This program uses Ukkonen's algorithm(1) and has" << endl;
-  cout << "average time complexity of O(d*d + n), and space complexity O(d)   (where d is the edit distance)" << endl;
+  cout << "average time complexity of O(d*d + n), and space complexity O(n)   (where d is the edit distance)" << endl;
 
   cout << endl;
 
@@ -50,22 +51,51 @@ void msg() {
 
   cout << endl << endl;
 
+  cout << "Usage: " << prog << " [-s | -o minOverlap] [mismatchCost indelCost]" << endl;
+  cout << "  -s  semi-global: align B with the best matching substring of A" << endl;
+  cout << "  -o  overlap: align a suffix of A with a prefix of B (or all of B)," << endl;
+  cout << "      using at least minOverlap chars of B" << endl;
+  cout << "  The costs are positive integers, 1 and 1 by default" << endl;
+  cout << endl << endl;
 }
 
 int main(int argc, char *argv[])
 {
   char A[MAXSTRING],B[MAXSTRING];
   int res;
-  Ukkonen t;
-
-  msg();
+  int mode = GLOBAL, minOverlap = 0;
+  int mismatch = 1, indel = 1;
+
+  msg(argv[0]);
+
+  if (argc>=2 && strcmp(argv[1],"-s")==0) {
+    mode = SEMI_GLOBAL;
+    argc--;
+    argv++;
+  } else if (argc>=3 && strcmp(argv[1],"-o")==0) {
+    mode = OVERLAP;
+    minOverlap = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc==3) {
+    mismatch = atoi(argv[1]);
+    indel = atoi(argv[2]);
+    if (mismatch<1 || indel<1) {
+      cerr << "Costs must be at least 1" << endl;
+      exit(1);
+    }
+  }
+  printf("Mismatch=%d Indel=%d\n", mismatch, indel);
+
+  Ukkonen t(mismatch, indel);
 
   cout << "Enter string A : ";
   cin >> A;
   cout << "Enter string B : ";
   cin >> B;
 
-  res = t.editCost(A,B);
+  res = t.editCost(A,B,mode,minOverlap);
   cout << endl << "Edit distance = " << res << endl;
   return 0;
 }
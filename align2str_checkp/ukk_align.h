@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) David Powell <david@drp.id.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+// file: ukk_align.h
+// This file contains the class Ukkonen_align, which uses Ukkonen's
+// algorithm to align 2 strings in O(n) space by using checkpoints on
+// columns of the ukkonen matrix.  (The last modSize costs, and their
+// check-point data, are kept for all lenA+lenB+1 diagonals.) Then recursion is performed on the two
+// parts of the matrix (before and after the checkpoint).  This is similar
+// to Hirshberg's technique for the DPA.  It needs the edit distance (and
+// the start and end diagonals) first, as found by Ukkonen::editCost().
+
+#ifndef __UKK_ALIGN_H__
+#define __UKK_ALIGN_H__
+
+#include <ctype.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+#define BIG_NEGATIVE -10	// Well maybe not that big :)
+
+#define INSERT     -1           // Direction of insert. (decrement diagonal)
+#define MISMATCH   0            // Same diagonal
+#define DELETE     1            // Increment diagonal
+
+#define MAX_DIR3(x,y,z) ((x)>(y) ? ((x)>=(z) ? INSERT : DELETE) : ((y)>=(z) ? MISMATCH : DELETE)) // MAX_DIR3 - Determine whether to insert, delete, mismatch.
+
+
+#define MAX2(x,y) ((x)>(y) ? (x) : (y))
+#define MIN2(x,y) ((x)<(y) ? (x) : (y))
+#define MAX3(x,y,z) ((x)>(y) ? ((x)>=(z) ? (x) : (z)) : ((y)>=(z) ? (y) :(z)))
+#define MIN3(x,y,z) MIN2(MIN2(x,y),z)
+
+class Ukkonen_align
+{
+private:
+  
+  struct checkpointT {		//Structure to store the checkpoint information
+    int diagonal;		// Diagonal that this cell comes from.
+    int distance;		// The cell contents (distance along A)
+    int entryDir;		// Direction for entry into this cell.
+    int cost;			// Cost of the cell
+  };
+  
+  char *A,*B;			// The two strings being compared
+  int lenA,lenB;
+  int mismatchCost, indelCost;
+  int modSize;			// Costs kept, more than either cost
+  
+  int *data;			// Array for ukkonen's algorithm, see row()
+  struct checkpointT *cpData;	// checkpoint data, see cpRow()
+
+  int offset;			// offset into the arrary (for -ve diagonals)
+
+  int numInsert, numMismatch, numDelete, numMatch; // some statistics variables
+  
+public:
+  int innerLoop,outerLoop;
+
+  Ukkonen_align(int mismatch = 1, int indel = 1) :
+    mismatchCost(mismatch), indelCost(indel)
+  {
+    modSize = MAX2(mismatch, indel) + 1;
+  }
+
+private:
+  // row(cost) and cpRow(cost) - one cost of the Ukkonen matrix, and of
+  // its checkpoint data, indexed by diagonal.  Only the last modSize
+  // costs are kept.
+  int *row(int cost)
+  {
+    return &data[(cost%modSize)*(lenA+lenB+1) + offset];
+  }
+  struct checkpointT *cpRow(int cost)
+  {
+    return &cpData[(cost%modSize)*(lenA+lenB+1) + offset];
+  }
+
+  // reach(cost, sCost) - how many diagonals either side of its start
+  // do_Ukk() has done for cost.  -1 if none.
+  int reach(int cost, int sCost)
+  {
+    return (cost<sCost ? -1 : (cost-sCost)/indelCost);
+  }
+
+  // stepCost(dir) - the cost of moving into a cell in direction dir
+  int stepCost(int dir)
+  {
+    return (dir==MISMATCH ? mismatchCost : indelCost);
+  }
+
+  // do_Ukk - Performs Ukkonens alogorithm from a give diagonal, cost to
+  // a finishing diagonal, cost. The ukkonen matrix is checkpointed at a cost
+  // half way between the starting and finishing cost. Then the do_Ukk recurses
+  // to determine the alignment.
+  //
+  // A step costs mismatchCost or indelCost, so the path may jump over the
+  // checkpoint cost.  The cell it splits at is the first on the path to
+  // cost at least the checkpoint, and the cost of that cell is kept in the
+  // CP info too.
+  int do_Ukk(int sDiag, int sCost, int sDist, int fDiag, int fCost)
+  {
+    int checkpoint;
+
+    if (sCost==fCost)		// Trivial case.
+      return sDist;
+
+    checkpoint = (fCost-sCost+1)/2 + sCost; // Cost to checkpoint at.
+
+    row(sCost)[sDiag] = sDist; // Starting point of the alogorithm
+     
+    for (int cost=sCost+1; cost<=fCost; cost++) {
+      int i;
+      // This cost, and the costs one mismatch and one indel back
+      int misCost = cost-mismatchCost, indCost = cost-indelCost;
+      int misReach = reach(misCost, sCost), indReach = reach(indCost, sCost);
+      int *cur = row(cost);
+      int *mis = (misReach<0 ? NULL : row(misCost));
+      int *ind = (indReach<0 ? NULL : row(indCost));
+      struct checkpointT *cpCur = cpRow(cost);
+      struct checkpointT *cpMis = (misReach<0 ? NULL : cpRow(misCost));
+      struct checkpointT *cpInd = (indReach<0 ? NULL : cpRow(indCost));
+
+      // Now loop over the diagonals.
+      // The MAX2/MIN2 calculation determines the necessary starting/finishing
+      // point so no unnessary work is done.
+      // Diagonals off the matrix (-lenB..lenA) are never used.
+      int spent = (cost-sCost)/indelCost, left = (fCost-cost)/indelCost;
+      for (i = MAX3(sDiag-spent, fDiag-left, -lenB);
+	   i <= MIN3(sDiag+spent, fDiag+left, lenA);
+	   i++) {
+	int v1,v2,v3,res;
+	
+	v1 = v2 = v3 = BIG_NEGATIVE;
+	if (i+1 <= lenA && abs(i+1-sDiag) <= indReach)
+	  v1 = ind[i+1];
+	if (abs(i-sDiag) <= misReach)
+	  v2 = mis[i]+1;
+	if (i-1 >= -lenB && abs(i-1-sDiag) <= indReach)
+	  v3 = ind[i-1]+1;
+	
+	res = MAX3(v1,v2,v3);
+	if (res<0) {		// Nothing of this cost gets here
+	  cur[i] = BIG_NEGATIVE;
+	  continue;
+	}
+	res = MIN3(res, lenA, lenB+i); // Stay on the matrix
+
+	while (A[res] && A[res] == B[res-i]) {// Extend the diagonal
+	  res++;
+	  innerLoop++;
+	}
+	
+	cur[i] = res;
+
+	int dir = MAX_DIR3(v1,v2,v3); // Was it an insert, delete or mismatch?
+	
+	if (cost - stepCost(dir) >= checkpoint) { // If past the checkpoint already, move CP info along
+	  cpCur[i] = (dir==MISMATCH ? cpMis : cpInd)[i-dir];
+	} else {             // If not, keep CP data up to date for when we do.
+	  cpCur[i].diagonal = i;
+	  cpCur[i].distance = res;
+	  cpCur[i].entryDir = dir;
+	  cpCur[i].cost = cost;
+	}
+	outerLoop++;
+      } //for
+    }
+
+    // Now the must determine the exact matrix cell to split at.
+    int splitCost = cpRow(fCost)[fDiag].cost;
+    int splitDiag = cpRow(fCost)[fDiag].diagonal;
+    int splitDist = cpRow(fCost)[fDiag].distance;
+    int splitDir  = cpRow(fCost)[fDiag].entryDir;
+    int fDist = row(fCost)[fDiag];
+
+    int r = do_Ukk(sDiag, sCost, sDist, splitDiag-splitDir,
+		   splitCost-stepCost(splitDir));
+
+    dispAlignment(splitDir, splitDiag-splitDir, r, splitDist);
+
+    do_Ukk(splitDiag, splitCost, splitDist, fDiag, fCost);
+    
+    return fDist;        // Return distance reached for finishing cost/diagonal
+  }
+  
+  // dispAlignment() - Display a single non-match (ie. mismatch, insertion or
+  // deletion) followed by a number of matches.
+  void dispAlignment(int dir, int diag, int dist, int newDist)
+  {
+    char ch1='-',ch2='-';
+    switch (dir) {
+    case INSERT:
+      ch2 = B[dist-diag];
+      numInsert++;
+      break;
+    case MISMATCH:
+      ch1 = A[dist];
+      ch2 = B[dist-diag];
+      numMismatch++;
+      break;
+    case DELETE:
+      ch1 = A[dist];
+      numDelete++;
+      break;
+    }
+    printf("<%c,%c> ",ch1,ch2);
+    
+    if (dir!=INSERT)
+      dist++;
+    for (int i=0;i<newDist-dist;i++, numMatch++)
+     printf("<%c,%c> ",A[i+dist],B[i+dist-diag-dir]);
+  }    
+
+  
+public:
+  // doAlign - is the entry point for the string alignment. It is necessary
+  // to also supply the edit distance for the two strings.
+  void doAlign(char strA[], char strB[], int editDist)
+  {
+    doAlign(strA, strB, editDist, 0, strlen(strA)-strlen(strB));
+  }
+
+  // doAlign - align from the start of diagonal sDiag to the end of
+  // diagonal fDiag (as found by Ukkonen::editCost() in any mode).  The
+  // rest of A and B is not displayed.
+  void doAlign(char strA[], char strB[], int editDist, int sDiag, int fDiag)
+  {
+    int sDist;
+
+    A = strA;
+    B = strB;
+    lenA = strlen(A);
+    lenB = strlen(B);
+
+    numMatch = numMismatch = numInsert = numDelete = 0;
+    innerLoop = outerLoop = 0;
+
+    // One entry for each diagonal of the matrix
+    offset = lenB;
+    
+    data = new int[(lenA+lenB+1)*modSize]; // Create room for Ukkonen matrix
+    cpData = new struct checkpointT[(lenA+lenB+1)*modSize]; // Make the CP data array.
+
+    // Calculate and display the initial matchings of A and B. (For entry
+    // (sDiag,0) in the Ukkonen matrix.
+    for (sDist=MAX2(sDiag,0); A[sDist] && A[sDist]==B[sDist-sDiag]; sDist++,numMatch++)
+      printf("<%c,%c> ",A[sDist],B[sDist-sDiag]);
+    
+    int fDist = do_Ukk(sDiag,0,sDist,fDiag,editDist);
+
+    delete[] data;
+    delete[] cpData;
+
+    cout << endl;
+    if (sDiag!=0 || fDiag!=lenA-lenB)
+      printf("Aligned A[%d..%d] with B[%d..%d]\n",
+	     MAX2(sDiag,0)+1, fDist, MAX2(-sDiag,0)+1, fDist-fDiag);
+  }
+  
+};
+
+#endif
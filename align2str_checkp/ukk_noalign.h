@@ -21,64 +21,140 @@
 // file: ukk_noalign.h
 // This file contains the class Ukkonen. Which provides a method editCost()
 // that calculates the edit distance between two strings using Ukkonen's
-// algorithm in O(nd) time and O(d) space, but no alignment information is
+// algorithm in O(nd) time and O(n) space, but no alignment information is
 // determined.
+//
+// A mismatch and an indel may each cost any positive integer (1 and 1 by
+// default, see the constructor).  A cell only needs the cells one mismatch
+// or one indel cheaper, so just the last modSize costs are kept for each
+// diagonal.  Not every cost can be had on every diagonal (with indels
+// costing 2, a cost of 1 gets nowhere), those cells are BIG_NEGATIVE.
+//
+// For the global edit distance the cells are done in the order Ukkonen's
+// recursion asks for them: when trying cost T, each cell (diag,cost) that
+// a path costing T could go through, so cost + |diag-finalDiag|*indelCost
+// is T, from the diagonals furthest from finalDiag in.  A cell done for T
+// is not read again after T+max(mismatchCost,indelCost)+indelCost, which
+// sets modSize (3 for unit costs).
+//
+// As well as the global edit distance it does two ends-free modes.  Both
+// let the alignment start anywhere along A (on any diagonal d>=0, at cost
+// 0) and stop at the first cost where any diagonal reaches an allowed end:
+//   SEMI_GLOBAL - B is aligned with a substring of A.  Leading and
+//                 trailing gaps in A are free.  Ends when j reaches lenB.
+//   OVERLAP     - a suffix of A is aligned with a prefix of B (or all of B,
+//                 if B is inside A).  Ends when i reaches lenA, or j
+//                 reaches lenB, with at least minOverlap chars of B used.
+//                 Of the least cost overlaps, the longest is taken.
 
 #include <stdlib.h>
+#include <string.h>
 
 #define BIG_NEGATIVE -10	// Well maybe not that big :)
 
+#define GLOBAL      0		// Alignment modes, see above
+#define SEMI_GLOBAL 1
+#define OVERLAP     2
+
 
 class Ukkonen
 {
   char *A, *B;			// Two strings to be aligned
-  int (*data)[3];		// 2 dimensional array of 'cost' rows,
- 				// and 3 columns.
+  int lenA, lenB;
+  int mismatchCost, indelCost;
+  int modSize;			// Costs kept, more than either cost
+  int *data;			// Furthest row reached for each diagonal
+				// and cost (mod modSize), see at()
+  int *start;			// The diagonal each cell's path started on
   
   int offset;			// Offset into data[] because -ve indices
 				// needed.
+  int startHi;			// Paths may start on diagonals 0..startHi
 public:
   int innerLoop, outerLoop;
+  int startDiag, endDiag;	// Where the alignment found starts and ends
+
+  Ukkonen(int mismatch = 1, int indel = 1) :
+    mismatchCost(mismatch), indelCost(indel)
+  {
+    modSize = (mismatch>indel ? mismatch : indel) + indel + 1;
+  }
 
 private:
   int max3(int x, int y, int z)
   {
     return (x>=y ? (x>=z ? x : z) : (y>=z ? y :z));
   }
-  
-  int Ukk(int diag, int cost)
+
+  // reached(diag, cost) - true if cell (diag,cost) is on the matrix and
+  // a path starting on diagonal 0..startHi could get to it.
+  int reached(int diag, int cost)
   {
-    int v1,v2,v3,res;
+    return cost>=0 && -diag*indelCost<=cost &&
+      (diag-startHi)*indelCost<=cost && diag<=lenA && diag>=-lenB;
+  }
+
+  // at(diag, cost) - the furthest row along diag for cost
+  int at(int diag, int cost)
+  {
+    return (reached(diag, cost) ? data[(diag+offset)*modSize + cost%modSize]
+	    : BIG_NEGATIVE);
+  }
   
-    if (diag==0 && cost==-1) return -1; // Starting condition
-    if (abs(diag)>cost) return BIG_NEGATIVE; // Boundary condition
+  // startOf(diag, cost) - the start diagonal of cell (diag,cost)
+  int startOf(int diag, int cost)
+  {
+    return start[(diag+offset)*modSize + cost%modSize];
+  }
 
-    if (data[diag+offset][cost%3]>=0)	// Check if already calculated
-      return data[diag+offset][cost%3];
+  // Ukk(diag, cost) - fill in cell (diag,cost).  The cells of lower
+  // cost it comes from must be done.  It must be reached().
+  int Ukk(int diag, int cost)
+  {
+    int v1,v2,v3,res,s;
+
+    if (cost==0) {
+      res = diag;		// Starting condition (row diag of (diag,0))
+      s = diag;
+    } else {
+      v1 = at(diag+1, cost-indelCost); 
+      v2 = at(diag,   cost-mismatchCost)+1; 
+      v3 = at(diag-1, cost-indelCost)+1; 
+      res = max3(v1,v2,v3);
+      // Ties go to v2, so a path keeps to its diagonal
+      s = (res==v2 ? startOf(diag, cost-mismatchCost) :
+	   res==v1 ? startOf(diag+1, cost-indelCost) :
+	   startOf(diag-1, cost-indelCost));
+    }
 
-    v1 = Ukk(diag+1, cost-1); 
-    v2 = Ukk(diag,   cost-1)+1; 
-    v3 = Ukk(diag-1, cost-1)+1; 
-    res = max3(v1,v2,v3);
+    if (res<0) {		// Nothing of this cost gets here
+      res = BIG_NEGATIVE;
+    } else {
+      if (res>lenA) res = lenA;	// Stay on the matrix
+      if (res>lenB+diag) res = lenB+diag;
 
-    while (A[res] && A[res] == B[res-diag]) { // Extend diagonal while matching
-      res++;
-      innerLoop++;
+      while (A[res] && A[res] == B[res-diag]) { // Extend diagonal while matching
+	res++;
+	innerLoop++;
+      }
     }
     outerLoop++;
 
-    data[diag+offset][cost%3] = res;
+    data[(diag+offset)*modSize + cost%modSize] = res;
+    start[(diag+offset)*modSize + cost%modSize] = s;
     
 //    printf("Diag=%d Cost=%d  Dist=%d\n",diag,cost,res);
 
     return res;
   }
-  
+
 public:
-  int editCost(char strA[], char strB[])
+  // editCost() - the least cost of aligning strA and strB, in the given
+  // mode.  Sets startDiag and endDiag.
+  int editCost(char strA[], char strB[], int mode = GLOBAL, int minOverlap = 0)
   {
-    int cost, res, maxCost;
-    int lenA, lenB, finalDiag;
+    int cost, diag, res;
+    int finalDiag;
 
     innerLoop = outerLoop = 0;
     
@@ -88,31 +164,59 @@ public:
     lenB = strlen(B);
     finalDiag = lenA-lenB;
 
-    maxCost = (lenA>lenB) ? lenA : lenB;
-    offset = (maxCost-(lenA-lenB))/2; // Offset to allow for -ve diagonals
-    // Now allocate storage. Largest possible edit distance by 3 columns needed
-    data = new int[maxCost+1][3];
-    
-    for (int i=0; i<=maxCost;i++) { // Initialize the structure
-      data[i][0] = BIG_NEGATIVE;
-      data[i][1] = BIG_NEGATIVE;
-      data[i][2] = BIG_NEGATIVE;
+    // One entry for each diagonal of the matrix
+    offset = lenB;
+    data = new int[(lenA+lenB+1)*modSize];
+    start = new int[(lenA+lenB+1)*modSize];
+
+    if (mode==GLOBAL) {
+      startHi = 0;
+      startDiag = 0;
+      endDiag = finalDiag;
+      for (cost=0; ; cost++) {
+	for (int k=cost/indelCost; k>=0; k--) {
+	  int c = cost - k*indelCost;
+	  if (reached(finalDiag+k, c))
+	    Ukk(finalDiag+k, c);
+	  if (k>0 && reached(finalDiag-k, c))
+	    Ukk(finalDiag-k, c);
+	}
+	if (at(finalDiag, cost)==lenA)
+	  break;
+      }
+      delete[] data;
+      delete[] start;
+      return cost;
     }
 
-    cost = 0;
-    do {
-      // Remove data for next iteration
-      for (int i=cost-3,j=finalDiag; i>=abs(j); i--,j++)
-	data[j+offset][i%3]  = BIG_NEGATIVE;
-      for (int i=cost-3,j=finalDiag; i>=abs(j); i--,j--)
-	data[j+offset][i%3]  = BIG_NEGATIVE;
-
-      res = Ukk(finalDiag, cost);
-      cost++;
-      
-    } while (res != lenA);
+    // The ends-free modes do each cost for every diagonal
+    startHi = lenA;
+    if (minOverlap>lenB) minOverlap = lenB;
+
+    for (cost=0; ; cost++) {
+      int lo = -(cost/indelCost), hi = startHi+cost/indelCost;
+      if (lo<-lenB) lo = -lenB;
+      if (hi>lenA) hi = lenA;
+
+      for (diag=lo; diag<=hi; diag++)
+	Ukk(diag, cost);
+
+      for (diag=lo; diag<=hi; diag++) {
+	res = at(diag, cost);
+	if (res<0 || res-diag<minOverlap)
+	  continue;
+	if (res-diag==lenB || (mode==OVERLAP && res==lenA)) {
+	  startDiag = startOf(diag, cost);
+	  endDiag = diag;
+	  break;
+	}
+      }
+      if (diag<=hi)
+	break;
+    }
 
-    return cost-1;
+    delete[] data;
+    delete[] start;
+    return cost;
   }
 };
-
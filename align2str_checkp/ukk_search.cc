@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) David Powell <david@drp.id.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+// file: ukk_search.cc
+// Finds where a pattern P occurs in a long text with at most k differences,
+// using Ukkonen's cutoff algorithm (E. Ukkonen, "Finding approximate
+// patterns in strings", J. of Algorithms, 1985, 6, pp 132-137).
+//
+// The text is read a character at a time and never held whole.  For each
+// text position j there is a column of the DPA, C[i] the least cost of
+// aligning P[0..i) with any text ending at j (so C[0] is always 0).  Only
+// the top of the column, down to the last cell of cost <= k ("lact"), can
+// lead to a hit, so each column is only done as far as lact+1 (or further
+// while an indel down from there stays within k).  Cells below are over k
+// and are just kept at k+1.  This averages O(k) cells a column, not O(m).
+//
+// A hit is an end j with C[m] <= k.  Where several ends in a row are hits,
+// only those whose cost is less than the end before, and no more than the
+// end after, are taken (the first of the best).  Each one is then aligned:
+// its start is found by a DPA back over the m+k/indelCost characters before
+// it, and that window of text is aligned with P by Ukkonen_align.
+
+#include <ctype.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ukk_align.h"
+
+using namespace std;
+
+#define MAXSTRING 20000          // Maximum size for reading in a string
+
+class Ukkonen_search
+{
+  char *P;			// The pattern
+  int m;
+  int k;			// Most differences allowed
+  int mismatchCost, indelCost;
+
+  int *col;			// The current column, C[0..m]
+  int lact;			// Last active cell of col: col[i]>k for i>lact
+
+  int W;			// Longest text an alignment of cost k can use
+  char *text;			// The last few text chars, text[0] is
+  long textBase;		//   position textBase
+  int textSize, textLen;
+
+  long pos;			// Text chars read so far
+  int prevCost;			// Cost of the end at pos-1 (k+1 if none)
+  long candEnd;			// A possible hit waiting on the next end
+  int candCost;
+
+  int *rcol;			// Column for findStart()
+
+public:
+  long cells, ends, hits;
+
+  Ukkonen_search(char *pattern, int maxCost, int mismatch = 1, int indel = 1) :
+    P(pattern), k(maxCost), mismatchCost(mismatch), indelCost(indel)
+  {
+    m = strlen(P);
+    col = new int[m+1];
+    rcol = new int[m+1];
+
+    for (int i=0; i<=m; i++)
+      col[i] = MIN2(i*indelCost, k+1);
+    for (lact=m; col[lact]>k; lact--) ;
+
+    W = m + k/indelCost;
+    textSize = 4*(W+2);
+    text = new char[textSize+1];
+    textBase = textLen = 0;
+
+    pos = 0;
+    prevCost = k+1;
+    candEnd = -1;
+    cells = ends = hits = 0;
+  }
+
+  ~Ukkonen_search()
+  {
+    delete[] col;
+    delete[] rcol;
+    delete[] text;
+  }
+
+private:
+  // keep(ch) - add ch to the text kept, dropping all but the last W+2
+  // chars when full
+  void keep(char ch)
+  {
+    if (textLen==textSize) {
+      int drop = textLen - (W+2);
+      memmove(text, text+drop, W+2);
+      textBase += drop;
+      textLen -= drop;
+    }
+    text[textLen++] = ch;
+  }
+
+  // findStart(end, cost) - the start of a window of text ending at end
+  // (exclusive) that P aligns with for cost.  A DPA run back from end:
+  // rcol[i] is the cost of aligning the last i chars of P with the text
+  // from s to end.  Takes the shortest such window.
+  long findStart(long end, int cost)
+  {
+    long lo = MAX2(end - W, textBase);
+
+    for (int i=0; i<=m; i++)
+      rcol[i] = i*indelCost;
+    if (rcol[m]==cost)
+      return end;
+
+    for (long s=end-1; s>=lo; s--) {
+      char ch = text[s-textBase];
+      int diag = rcol[0];
+      rcol[0] += indelCost;
+      for (int i=1; i<=m; i++) {
+	int v = MIN3(diag + (P[m-i]==ch ? 0 : mismatchCost),
+		     rcol[i] + indelCost, rcol[i-1] + indelCost);
+	diag = rcol[i];
+	rcol[i] = v;
+      }
+      if (rcol[m]==cost)
+	return s;
+    }
+
+    printf("BAD logic!");  exit(911);
+  }
+
+  // report(end, cost) - display a hit and its alignment.  If the
+  // cheapest window is empty (cost >= m*indelCost) the whole
+  // pattern is deleted, so there is nothing to align.
+  void report(long end, int cost)
+  {
+    long start = findStart(end, cost);
+    int len = end - start;
+
+    hits++;
+    if (len==0) {
+      printf("\nHit %ld: text[] (empty) at %ld  cost = %d\n", hits, end, cost);
+      return;
+    }
+    printf("\nHit %ld: text[%ld..%ld]  cost = %d\n", hits, start+1, end, cost);
+
+    char *window = new char[len+1];
+
+    memcpy(window, text + (start-textBase), len);
+    window[len] = 0;
+
+    Ukkonen_align t(mismatchCost, indelCost);
+    t.doAlign(window, P, cost);
+
+    delete[] window;
+  }
+
+  // nextEnd(cost) - the cost of the end at pos (k+1 if not a hit).
+  // Reports the waiting candidate once the cost after it is known.
+  void nextEnd(int cost)
+  {
+    if (candEnd>=0 && cost>=candCost) {
+      report(candEnd, candCost);
+      candEnd = -1;
+    } else if (candEnd>=0)
+      candEnd = -1;		// Keeps going down, the next is better
+
+    if (cost<=k && cost<prevCost) {
+      candEnd = pos;
+      candCost = cost;
+    }
+    prevCost = cost;
+  }
+
+public:
+  // add(ch) - move the column on past text char ch
+  void add(char ch)
+  {
+    int i, diag = col[0];
+
+    keep(ch);
+    pos++;
+
+    for (i=1; i<=m && (i<=lact+1 || col[i-1]+indelCost<=k); i++) {
+      int v = MIN3(diag + (P[i-1]==ch ? 0 : mismatchCost),
+		   col[i] + indelCost, col[i-1] + indelCost);
+      diag = col[i];
+      col[i] = MIN2(v, k+1);
+      cells++;
+    }
+
+    for (lact=i-1; col[lact]>k; lact--) ;
+
+    if (lact==m) {
+      ends++;
+      nextEnd(col[m]);
+    } else
+      nextEnd(k+1);
+  }
+
+  // finish() - the text has ended, report any hit still waiting
+  void finish()
+  {
+    nextEnd(k+1);
+  }
+
+  long length() { return pos; }
+};
+
+void msg(char *prog) {
+  cout << "Copyright (C) David Powell <david@drp.id.au>" << endl;
+  cout << "  This program comes with ABSOLUTELY NO WARRANTY; and is provided" << endl;
+  cout << "  under the GNU Public License v2, for details see file COPYRIGHT" << endl << endl;
+
+  cout << "This program finds where a pattern occurs in a text with at most k" << endl;
+  cout << "differences, and displays an alignment for each.  The text is streamed" << endl;
+  cout << "through the cutoff algorithm of Ukkonen(1), which has average time" << endl;
+  cout << "complexity of O(k*n).  The hits are aligned with Ukkonen's algorithm(2)" << endl;
+  cout << "and check-pointing(3)" << endl;
+
+  cout << endl;
+
+  cout << "1:  E. Ukkonen, \"Finding Approximate Patterns in Strings\"," << endl;
+  cout << "    Journal of Algorithms, 1985, 6:1, pp 132-137" << endl;
+
+  cout << endl;
+
+  cout << "2:  E. Ukkonen, \"On Approximate String Matching\"," << endl;
+  cout << "    Foundations of Computation Theory, 1983, 158, pp 487-495" << endl;
+
+  cout << endl;
+
+  cout << "3:  D. R. Powell, L. Allison and T. I. Dix," << endl;
+  cout << "    \"A Versatile Divide and Conquer Technique for Optimal String Alignment\"," << endl;
+  cout << "    Information Processing Letters, 1999, 70:3, pp 127-139" << endl;
+
+  cout << endl << endl;
+
+  cout << "Usage: " << prog << " k [mismatchCost indelCost]" << endl;
+  cout << "  k   the most a hit may cost" << endl;
+  cout << "  The costs are positive integers, 1 and 1 by default" << endl;
+  cout << "  The pattern is read first, then the text up to the end of input" << endl;
+  cout << "  (white space in the text is skipped)" << endl;
+  cout << endl << endl;
+}
+
+int main(int argc, char *argv[])
+{
+  char P[MAXSTRING];
+  int k, ch;
+  int mismatch = 1, indel = 1;
+
+  msg(argv[0]);
+
+  if (argc!=2 && argc!=4) {
+    cerr << "Need the most differences allowed, k" << endl;
+    exit(1);
+  }
+  k = atoi(argv[1]);
+  if (k<0) {
+    cerr << "k must be at least 0" << endl;
+    exit(1);
+  }
+  if (argc==4) {
+    mismatch = atoi(argv[2]);
+    indel = atoi(argv[3]);
+    if (mismatch<1 || indel<1) {
+      cerr << "Costs must be at least 1" << endl;
+      exit(1);
+    }
+  }
+  printf("k=%d Mismatch=%d Indel=%d\n", k, mismatch, indel);
+
+  cout << "Enter pattern : ";
+  cin >> P;
+  cout << "Enter text : ";
+
+  Ukkonen_search t(P, k, mismatch, indel);
+
+  while ((ch = cin.get()) != EOF)
+    if (!isspace(ch))
+      t.add(ch);
+  t.finish();
+
+  cout << endl << endl << "LenP=" << strlen(P) << "   lenText=" << t.length();
+  cout << endl << "Cells = " << t.cells << endl;
+  cout << "Ends with cost <= k = " << t.ends << "   Hits = " << t.hits << endl;
+
+  return 0;
+}
@@ -24,6 +24,7 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 using namespace std;
 
@@ -32,6 +33,7 @@ using namespace std;
 
 
 #define MAX2(x,y) ((x)>(y) ? (x) : (y))
+#define MIN2(x,y) ((x)<(y) ? (x) : (y))
 #define MAX3(x,y,z) ((x)>=(y) ? ((x)>=(z) ? (x) : (z)) : ((y)>=(z) ? (y) :(z)))
 
 #define MIN3(x,y,z) ((x)<=(y) ? ((x)<=(z) ? (x) : (z)) : ((y)<=(z) ? (y) :(z)))
@@ -60,6 +62,37 @@ public:
     B[strlen(B)-1] = 0;
   }
 
+  // readLine(prompt) - a line of any length from stdin, without the
+  // \n, for strings too long for readStrings().  The caller must
+  // delete[] it.
+  static char *readLine(const char *prompt) {
+    int size = MAXSTRING, len = 0;
+    char *s = new char[size];
+
+    cout << prompt << flush;
+    s[0] = 0;
+    while (fgets(s+len, size-len, stdin)) {
+      len += strlen(s+len);
+      if (len>0 && s[len-1]=='\n') {
+        s[--len] = 0;
+        return s;
+      }
+      if (len==size-1) {	// Line not all read yet
+        char *bigger = new char[2*size];
+        memcpy(bigger, s, len+1);
+        delete[] s;
+        s = bigger;
+        size *= 2;
+      }
+    }
+
+    if (len==0) {
+      cerr << "Error reading input" << endl;
+      exit(1);
+    }
+    return s;			// Last line, with no \n
+  }
+
 };
 
 #endif
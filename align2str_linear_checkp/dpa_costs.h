@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) David Powell <david@drp.id.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+// Costs for the dpa_ programs, shared by dpa_linear, dpa_lcheckp,
+// dpa_lhirsch and dpa_fwdbwd.
+
+#ifndef __DPA_COSTS_H__
+#define __DPA_COSTS_H__
+
+#define _a 3			// insert(delete) cost = w(k) = a+b*k
+#define _b 1			// Where k is number or inserts(deletes)
+#define _MatchCost    0		// Cost of a match
+#define _MismatchCost 1		// Cost of a mismatch
+
+// The costs are a template parameter of DPAlinear.  FixedCosts<>
+// makes them compile time constants, so the inner loops are compiled
+// for just those costs.  RuntimeCosts holds any others (as read from
+// the command line).  Either way they are used as Cost::MatchCost,
+// Cost::MismatchCost, Cost::a and Cost::b.
+template <int Match, int Mismatch, int Open, int Extend>
+struct FixedCosts {
+  static const int matrix = 0;
+  static const int MatchCost = Match;
+  static const int MismatchCost = Mismatch;
+  static const int a = Open;
+  static const int b = Extend;
+};
+
+struct RuntimeCosts {
+  static const int matrix = 0;
+  static int MatchCost;
+  static int MismatchCost;
+  static int a;
+  static int b;
+};
+
+int RuntimeCosts::MatchCost = _MatchCost;
+int RuntimeCosts::MismatchCost = _MismatchCost;
+int RuntimeCosts::a = _a;
+int RuntimeCosts::b = _b;
+
+// MatrixCosts takes the diag costs from SubMatrix, through the query
+// profile (see DPAlinear::rowProfile).  Cost::matrix is a constant,
+// so with the other costs the profile code is compiled out.
+// MatchCost and MismatchCost are the smallest and largest cost in
+// the matrix, so range checks on the two cover all of it.
+struct MatrixCosts {
+  static const int matrix = 1;
+  static int MatchCost;
+  static int MismatchCost;
+  static int a;
+  static int b;
+};
+
+int MatrixCosts::MatchCost, MatrixCosts::MismatchCost;
+int MatrixCosts::a, MatrixCosts::b;
+
+// The costs that get their own copy of the inner loops, as
+// X(MatchCost, MismatchCost, a, b).  Others use RuntimeCosts.
+#define COMMON_COSTS(X) \
+  X(0, 1, 3, 1)		/* The compiled in default */ \
+  X(0, 1, 0, 1)		/* Gaps cost the same as mismatches */ \
+  X(0, 4, 6, 2)		/* Common for DNA reads */
+
+// Use in a COMMON_COSTS() chain: if RuntimeCosts match, do 'run'
+// with those costs as constants.  The chain must be followed by the
+// statement for any other costs.
+#define IF_COSTS(m, x, o, e, run) \
+  if (RuntimeCosts::MatchCost==(m) && RuntimeCosts::MismatchCost==(x) && \
+      RuntimeCosts::a==(o) && RuntimeCosts::b==(e)) { \
+    typedef FixedCosts<m, x, o, e> Cost; \
+    run; \
+  } else
+
+// Sums of a Score and a cost are done in a type wide enough
+// that they can not wrap.
+template <class Score> struct WideScore { typedef long long type; };
+template <> struct WideScore<short> { typedef int type; };
+
+#endif
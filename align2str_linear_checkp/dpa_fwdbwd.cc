@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) David Powell <david@drp.id.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+// Sums over all alignments of 2 strings with linear insert/delete costs,
+// instead of finding the best one.  An alignment of cost c is given the
+// weight exp(-c/T).  A forward and a backward DPA pass add these up over
+// the same three states as dpa_lcheckp, in log space so that long strings
+// don't underflow.  Between them they give the total weight Z, and the
+// probability that each pair of characters is matched.
+// The forward pass needs the backward rows in the opposite order to the
+// one they are made in, so they are check-pointed on several levels (J. A.
+// Grice, R. Hughey and D. Speck, "Reduced space sequence alignment",
+// CABIOS, 1997, 13:1, pp 45-53).  As in dpa_lcheckp, a check-point row
+// stands in for the rows it is made from.  A range of rows is split into
+// k pieces.  The backward rows are run up it from the row at its bottom,
+// keeping the k-1 rows where one piece ends, and then each piece is done
+// the same way, in order, one level down.  A piece of k rows or fewer is
+// recomputed whole.  k is the fan-out that needs the fewest levels L
+// while holding no more than MAX_ROWS backward rows ((L+1)*(k-1)+1: the
+// check-points, the other rows of a piece and the row at the bottom), so
+// the space does not grow with the number of rows.
+// So Time complexity O(n*n*L)    Space complexity O(n)
+// (L is 2 or 3 for strings of up to 20000)
+
+
+#include <ctype.h>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "submatrix.h"
+#include "dpa_costs.h"
+
+using namespace std;
+
+#define _T        1.0		// Temperature, costs are weighted exp(-cost/T)
+#define MAX_ROWS  64		// Most backward rows held at once
+
+#define LOG_ZERO (-HUGE_VAL)	// log(0), the weight of no paths at all
+
+double T = _T;
+
+// logSum(x,y,z) - log(exp(x)+exp(y)+exp(z)), without leaving log space
+static inline double logSum(double x, double y, double z)
+{
+  double m = MAX3(x,y,z);
+
+  if (m == LOG_ZERO)
+    return LOG_ZERO;
+  return m + log(exp(x-m) + exp(y-m) + exp(z-m));
+}
+
+
+template <class Cost>
+class DPAfwdbwd
+{
+  private:
+
+    // enumerated type for the possible directions
+    enum direction {horz=0, vert=1, diag=2};
+
+    // Each cell of the dpa matrix has 3 states, one for each
+    // possible previous operation.  Each holds the log of the summed
+    // weight of the paths that end (forward) or start (backward)
+    // in that state.
+    struct dpaElem {
+      double d[3];
+    };
+
+    char *A,*B;			// The two strings being compared
+
+    int lenA,lenB;
+
+    // Log weights of the steps: into a gap from another state costs
+    // a+b, staying in it costs b.  A match or mismatch (without a
+    // matrix) costs MatchCost or MismatchCost.
+    double gapOpen, gapExt;
+    double matchWeight, mismatchWeight;
+    double costWeight;		// Log weight of a cost of 1, -1/T
+
+    int *rowProfile;		// MatrixCosts only.  The query profile: for
+				// each residue code, the diag cost against
+				// each column of B.  Row code is at
+				// rowProfile[code*(lenB+1)], see profRow().
+
+    struct dpaElem *fwd[2];	// The last two rows of the forward pass
+    struct dpaElem *bwd[2];	// Scratch rows of the backward pass
+    int cur;			// The forward row being filled
+
+    int k;			// Pieces a range of rows is split into
+    int nLevels;		// Levels of splitting
+    struct dpaElem **check;	// The k-1 check-points of each level, from
+				// check[1], and the last row in check[0]
+    struct dpaElem **block;	// Backward rows of a piece of k rows,
+				// but for the one it starts from
+
+    double logZ;		// Log of the weight of all alignments
+
+    // For each row i of A: the column with the most likely match,
+    // its probability, and the probability A[i-1] is matched at all
+    int *bestCol;
+    double *bestProb, *matchProb;
+
+    // profRow(c) - the profile row for the char c of A.  Indexed by
+    // column of B, from 1.
+    const int *profRow(char c)
+    {
+      return &rowProfile[SubMatrix::code[(unsigned char)c] * (long)(lenB+1)];
+    }
+
+    // makeProfile() - fill in rowProfile[], once for the whole alignment
+    void makeProfile()
+    {
+      rowProfile = new int[SubMatrix::nCodes * (long)(lenB+1)];
+      for (int c=0; c<SubMatrix::nCodes; c++) {
+        int *row = &rowProfile[c * (long)(lenB+1)];
+        row[0] = 0;
+        for (int j=1; j<=lenB; j++)
+          row[j] = SubMatrix::cost[c][SubMatrix::code[(unsigned char)B[j-1]]];
+      }
+    }
+
+    // diagWeight(ch, pRow, j) - log weight of matching ch (a char
+    // of A, whose profile row is pRow) with B[j-1]
+    double diagWeight(char ch, const int *pRow, int j) {
+      if (Cost::matrix)
+        return pRow[j] * costWeight;
+      return (ch==B[j-1] ? matchWeight : mismatchWeight);
+    }
+
+    // fwdRow(i, prev, cur) - row i of the forward pass, from row
+    // i-1 in prev (NULL for the first row).  The paths start at
+    // (0,0) in the diag state, so the first gap must be opened.
+    void fwdRow(int i, struct dpaElem *prev, struct dpaElem *cur) {
+      char ch = (i>0 ? A[i-1] : 0);
+      const int *pRow = (Cost::matrix && i>0 ? profRow(ch) : NULL);
+
+      for (int j=0; j<=lenB; j++) {
+        struct dpaElem &c = cur[j];
+
+        if (i==0 && j==0) {
+          c.d[horz] = c.d[vert] = LOG_ZERO;
+          c.d[diag] = 0;
+          continue;
+        }
+
+        if (j>0) {
+          struct dpaElem &l = cur[j-1];
+          c.d[horz] = logSum(l.d[horz] + gapExt, l.d[vert] + gapOpen,
+                             l.d[diag] + gapOpen);
+        } else
+          c.d[horz] = LOG_ZERO;
+
+        if (prev) {
+          struct dpaElem &u = prev[j];
+          c.d[vert] = logSum(u.d[horz] + gapOpen, u.d[vert] + gapExt,
+                             u.d[diag] + gapOpen);
+        } else
+          c.d[vert] = LOG_ZERO;
+
+        if (prev && j>0) {
+          struct dpaElem &ul = prev[j-1];
+          c.d[diag] = logSum(ul.d[horz], ul.d[vert], ul.d[diag]) +
+                      diagWeight(ch, pRow, j);
+        } else
+          c.d[diag] = LOG_ZERO;
+      }
+    }
+
+    // bwdRow(i, next, cur) - row i of the backward pass, from row
+    // i+1 in next (NULL for the last row).  A path may end in any
+    // state at (lenA,lenB).  The state of a cell decides what the
+    // next gap step costs.
+    void bwdRow(int i, struct dpaElem *next, struct dpaElem *cur) {
+      char ch = (i<lenA ? A[i] : 0);
+      const int *pRow = (Cost::matrix && i<lenA ? profRow(ch) : NULL);
+
+      for (int j=lenB; j>=0; j--) {
+        struct dpaElem &c = cur[j];
+
+        if (i==lenA && j==lenB) {
+          c.d[horz] = c.d[vert] = c.d[diag] = 0;
+          continue;
+        }
+
+        double h = (j<lenB ? cur[j+1].d[horz] : LOG_ZERO);
+        double v = (next ? next[j].d[vert] : LOG_ZERO);
+        double d = (next && j<lenB ?
+                    next[j+1].d[diag] + diagWeight(ch, pRow, j+1) : LOG_ZERO);
+
+        c.d[horz] = logSum(h + gapExt,  v + gapOpen, d);
+        c.d[vert] = logSum(h + gapOpen, v + gapExt,  d);
+        c.d[diag] = logSum(h + gapOpen, v + gapOpen, d);
+      }
+    }
+
+    // posteriors(i, f, bk) - the match probabilities on row i, from
+    // its forward and backward rows
+    void posteriors(int i, struct dpaElem *f, struct dpaElem *bk) {
+      double best = 0, sum = 0;
+      int bestJ = 0;
+
+      for (int j=1; j<=lenB; j++) {
+        double p = exp(f[j].d[diag] + bk[j].d[diag] - logZ);
+        sum += p;
+        if (p > best) {
+          best = p;
+          bestJ = j;
+        }
+      }
+
+      bestCol[i] = bestJ;
+      bestProb[i] = best;
+      matchProb[i] = sum;
+    }
+
+    // fwdStep(i, bk) - forward row i, given backward row i.  Rows
+    // must come in order from 0.  Row 0 of the backward pass sets logZ.
+    void fwdStep(int i, struct dpaElem *bk) {
+      fwdRow(i, (i>0 ? fwd[1-cur] : NULL), fwd[cur]);
+      if (i>0)
+        posteriors(i, fwd[cur], bk);
+      else
+        logZ = bk[0].d[diag];
+      cur = 1-cur;
+    }
+
+    // levels(k) - levels of splitting a range of lenA+1 rows into
+    // k pieces needs, before every piece is k rows or fewer
+    int levels(int k) {
+      int L = 0;
+
+      for (int r=lenA+1; r>k; r=(r+k-1)/k)
+        L++;
+      return L;
+    }
+
+    // chooseSplit() - set k and nLevels.  The fewest levels that fit
+    // in MAX_ROWS, with the smallest k that gets them.  k=2 always
+    // fits, as MAX_ROWS-2 levels of halving cover more rows than an
+    // int can count.
+    void chooseSplit() {
+      k = 2;
+      nLevels = levels(k);
+      for (int n=3; n<=MAX_ROWS; n++) {
+        int L = levels(n);
+        if ((L+1)*(n-1) + 1 > MAX_ROWS)
+          continue;
+        if ((nLevels+1)*(k-1) + 1 > MAX_ROWS || L < nLevels) {
+          k = n;
+          nLevels = L;
+        }
+        if (L == 0)
+          break;
+      }
+    }
+
+    // doRange(i0, i1, bottom, l) - the forward rows i0..i1, given
+    // backward row i1 in bottom.  The range is split into pieces
+    // with level l's check-points, and each piece is done on level
+    // l+1.  A range of k rows or fewer has all its backward rows
+    // recomputed into block[].
+    void doRange(int i0, int i1, struct dpaElem *bottom, int l) {
+      if (i1-i0+1 <= k) {
+        for (int i=i1-1; i>=i0; i--)
+          bwdRow(i, (i==i1-1 ? bottom : block[i-i0+1]), block[i-i0]);
+        for (int i=i0; i<=i1; i++)
+          fwdStep(i, (i==i1 ? bottom : block[i-i0]));
+        return;
+      }
+
+      int size = (i1-i0+1 + k-1)/k;	// Rows in a piece
+      struct dpaElem **cp = &check[1 + l*(k-1)];
+      struct dpaElem *next = bottom;
+      int r = 0;
+
+      // Up to the end of the first piece, keeping the row each
+      // piece ends on.  Piece p ends on row i0+(p+1)*size-1.
+      for (int i=i1-1; i>=i0+size-1; i--) {
+        struct dpaElem *row;
+        if ((i-i0+1) % size == 0)
+          row = cp[(i-i0+1)/size - 1];
+        else {
+          row = bwd[r];
+          r = 1-r;
+        }
+        bwdRow(i, next, row);
+        next = row;
+      }
+
+      for (int s=i0; s<=i1; s+=size) {
+        int e = MIN2(s+size-1, i1);
+        doRange(s, e, (e==i1 ? bottom : cp[(e-i0+1)/size - 1]), l+1);
+      }
+    }
+
+  public:
+
+    DPAfwdbwd() : rowProfile(NULL) {}
+
+    ~DPAfwdbwd() {
+      delete[] rowProfile;
+    }
+
+    // doFwdBwd(A,B) - run both passes.  Returns log Z.
+    double doFwdBwd(char *iA, char *iB) {
+      A = iA;
+      B = iB;
+      lenA = strlen(A);
+      lenB = strlen(B);
+
+      costWeight = -1 / T;
+      gapOpen = ((double)Cost::a + Cost::b) * costWeight;
+      gapExt  = Cost::b * costWeight;
+      matchWeight = Cost::MatchCost * costWeight;
+      mismatchWeight = Cost::MismatchCost * costWeight;
+      if (Cost::matrix)
+        makeProfile();
+
+      chooseSplit();
+      int nCheck = 1 + nLevels*(k-1);
+
+      for (int r=0; r<2; r++) {
+        fwd[r] = new struct dpaElem[lenB+1];
+        bwd[r] = new struct dpaElem[lenB+1];
+      }
+      check = new struct dpaElem *[nCheck];
+      for (int c=0; c<nCheck; c++)
+        check[c] = new struct dpaElem[lenB+1];
+      block = new struct dpaElem *[k-1];
+      for (int r=0; r<k-1; r++)
+        block[r] = new struct dpaElem[lenB+1];
+
+      bestCol = new int[lenA+1];
+      bestProb = new double[lenA+1];
+      matchProb = new double[lenA+1];
+
+      cur = 0;
+      bwdRow(lenA, NULL, check[0]);
+      doRange(0, lenA, check[0], 0);
+
+      for (int r=0; r<2; r++) {
+        delete[] fwd[r];
+        delete[] bwd[r];
+      }
+      for (int c=0; c<nCheck; c++)
+        delete[] check[c];
+      delete[] check;
+      for (int r=0; r<k-1; r++)
+        delete[] block[r];
+      delete[] block;
+
+      return logZ;
+    }
+
+    // printPosteriors() - for each character of A, its most likely
+    // partner in B and how likely A[i] is matched to anything
+    void printPosteriors() {
+      printf("  i A     j B   P(i~j)  P(i matched)\n");
+      for (int i=1; i<=lenA; i++) {
+        if (bestCol[i])
+          printf("%3d %c %5d %c   %.4f  %.4f\n", i, A[i-1],
+                 bestCol[i], B[bestCol[i]-1], bestProb[i], matchProb[i]);
+        else
+          printf("%3d %c     - -   %.4f  %.4f\n", i, A[i-1],
+                 bestProb[i], matchProb[i]);
+      }
+
+      delete[] bestCol;
+      delete[] bestProb;
+      delete[] matchProb;
+    }
+
+};
+
+void msg(char *prog) {
+  cout << "Copyright (C) David Powell <david@drp.id.au>" << endl;
+  cout << "  This program comes with ABSOLUTELY NO WARRANTY; and is provided" << endl;
+  cout << "  under the GNU Public License v2, for details see file COPYRIGHT" << endl << endl;
+
+  cout << "This program sums over all alignments of two strings under linear gap" << endl;
+  cout << "costs, each weighted exp(-cost/T), with a forward and a backward DPA pass" << endl;
+  cout << "in log space.  It displays the total as -T*log(Z), and for each character" << endl;
+  cout << "of A its most likely match in B.  The backward pass is check-pointed(1)" << endl;
+  cout << "on a few levels, holding at most " << MAX_ROWS << " of its rows at once.  It has time" << endl;
+  cout << "complexity of O(n*n*L) for L levels (2 or 3 in practice), and space" << endl;
+  cout << "complexity of O(n)" << endl;
+  cout << endl;
+  cout << "1:  D. R. Powell, L. Allison and T. I. Dix," << endl;
+  cout << "    \"A Versatile Divide and Conquer Technique for Optimal String Alignment\"," << endl;
+  cout << "    Information Processing Letters, 1999, 70:3, pp 127-139" << endl;
+
+  cout << endl << endl;
+
+  cout << "Usage: " << prog << " [-T temp] [matchCost mismatchCost a b]" << endl;
+  cout << "   or: " << prog << " [-T temp] -m matrixFile [a b]" << endl;
+  cout << "  where cost for gap of length k = a + b*k" << endl;
+  cout << "  -T  the temperature (default 1).  Small T favours the best" << endl;
+  cout << "      alignments, as T goes to 0 -T*log(Z) goes to the edit cost" << endl;
+  cout << "  -m  take the substitution costs from a matrix of scores, in the" << endl;
+  cout << "      NCBI format (eg BLOSUM62).  A score s is used as the cost -s" << endl;
+  cout << endl << endl;
+}
+
+// fwdBwd(A, B) - run the passes with costs Cost, and display the
+// match probabilities.  Returns log Z.
+template <class Cost>
+double fwdBwd(char *A, char *B)
+{
+  DPAfwdbwd<Cost> t;
+  double logZ = t.doFwdBwd(A,B);
+
+  cout << endl;
+  t.printPosteriors();
+  cout << endl;
+  return logZ;
+}
+
+int main(int argc, char *argv[])
+{
+  char A[MAXSTRING],B[MAXSTRING];
+  double logZ;
+
+  msg(argv[0]);
+
+  if (argc>=3 && strcmp(argv[1],"-T")==0) {
+    T = atof(argv[2]);
+    if (!(T > 0)) {
+      cerr << "The temperature must be more than 0" << endl;
+      exit(1);
+    }
+    argc -= 2;
+    argv += 2;
+  }
+
+  if (argc>=3 && strcmp(argv[1], "-m")==0) {
+    SubMatrix::read(argv[2]);
+    MatrixCosts::MatchCost = SubMatrix::lo;
+    MatrixCosts::MismatchCost = SubMatrix::hi;
+    MatrixCosts::a = _a;
+    MatrixCosts::b = _b;
+    if (argc==5) {
+      MatrixCosts::a = atoi(argv[3]);
+      MatrixCosts::b = atoi(argv[4]);
+    }
+    printf("Matrix=%s a=%d b=%d T=%g\n",argv[2],MatrixCosts::a,MatrixCosts::b,T);
+  } else {
+    if (argc==5) {
+      RuntimeCosts::MatchCost = atoi(argv[1]);
+      RuntimeCosts::MismatchCost = atoi(argv[2]);
+      RuntimeCosts::a = atoi(argv[3]);
+      RuntimeCosts::b = atoi(argv[4]);
+    }
+
+    printf("Match=%d Mis=%d a=%d b=%d T=%g\n",RuntimeCosts::MatchCost,
+	   RuntimeCosts::MismatchCost,RuntimeCosts::a,RuntimeCosts::b,T);
+  }
+
+  Common::readStrings(A, B);
+
+#define TRY_COSTS(m, x, o, e) IF_COSTS(m, x, o, e, logZ = fwdBwd<Cost>(A, B))
+  if (SubMatrix::nCodes) {
+    SubMatrix::check(A);
+    SubMatrix::check(B);
+    logZ = fwdBwd<MatrixCosts>(A, B);
+  } else {
+    COMMON_COSTS(TRY_COSTS)
+      logZ = fwdBwd<RuntimeCosts>(A, B);
+  }
+
+  printf("log Z = %.6f\n", logZ);
+  printf("Total score (-T*log Z) = %.6f\n", -T*logZ);
+
+
+  return 0;
+}
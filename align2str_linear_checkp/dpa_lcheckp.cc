@@ -29,26 +29,74 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <limits>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "common.h"
+#include "submatrix.h"
+#include "dpa_costs.h"
 
 using namespace std;
 
-#define _a 3			// insert(delete) cost = w(k) = a+b*k
-#define _b 1			// Where k is number or inserts(deletes)
-#define _MatchCost    0		// Cost of a match
-#define _MismatchCost 1		// Cost of a mismatch
+#define TILE_SIZE      256	// Rows (and columns) in a tile of the wavefront
+#define TILE_MIN_CELLS (4*TILE_SIZE*TILE_SIZE) // Smaller passes are not tiled
+#define BLOCK_SIZE     32	// Recursion stops at blocks this size (<= TILE_SIZE)
+#define LANES          8	// 16 bit scores in an SSE2 register
+#define BAND_STRIPED   16	// Bands over 1/this of a pass are done striped
+#define UNKNOWN_COST   (numeric_limits<long long>::min()) // doDPA() cost not known yet
 
 #define MINDIR3(h,v,d) ((h)<=(v) ? \
                         ((h)<=(d) ? horz : diag) : \
                         ((v)<=(d) ? vert : diag))
 
-int a = _a;
-int b = _b;
-int MatchCost = _MatchCost;
-int MismatchCost = _MismatchCost;
 
+#ifdef __SSE2__
+// Pick the cheapest of h, v and d, with the same ties as MINDIR3,
+// and blend the matching 'from' into *m
+static inline __m128i pick3(__m128i h, __m128i v, __m128i d,
+                            __m128i mh, __m128i mv, __m128i md,
+                            __m128i *m)
+{
+  __m128i isH = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(h, v),
+                                              _mm_cmpgt_epi16(h, d)),
+                                 _mm_set1_epi32(-1));
+  __m128i isV = _mm_andnot_si128(_mm_cmpgt_epi16(v, d),
+                                 _mm_cmplt_epi16(v, h));
+  *m = _mm_or_si128(_mm_or_si128(_mm_and_si128(isH, mh),
+                                 _mm_and_si128(isV, mv)),
+                    _mm_andnot_si128(_mm_or_si128(isH, isV), md));
+  return _mm_min_epi16(_mm_min_epi16(h, v), d);
+}
+
+// Move each lane up one, and put 'first' in lane 0
+static inline __m128i shiftIn(__m128i v, short first)
+{
+  return _mm_insert_epi16(_mm_slli_si128(v, 2), first, 0);
+}
 
+static inline __m128i outOfRange(__m128i v, short big)
+{
+  return _mm_or_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16(big-1)),
+                      _mm_cmplt_epi16(v, _mm_set1_epi16(-big+1)));
+}
+#endif
+
+// Pruning (-p).  A state whose cost plus a lower bound on the rest of
+// the pass is more than the pass can cost is not on an optimal path, so
+// it is set to 'big'.  The counts are of cells done, cells done and then
+// pruned, and cells skipped as no live cell leads to them.
+int prune = 0;
+long cellCount, pruneCount, skipCount;
+
+// Score is the integer type costs are held in.  The narrower it
+// is, the less memory each pass sweeps over.  Any cost that does
+// not fit sets 'overflow', and the caller tries a wider type.  Cost
+// is FixedCosts<> or RuntimeCosts.
+template <class Score, class Cost>
 class DPAlinear
 {
   private:
@@ -59,10 +107,9 @@ class DPAlinear
     // a 'state' corresponds to the incoming direction in
     // the dpa matrix
     struct stateType {
-      int cost;
-
       int fromCol;
-      direction fromDir;
+      Score cost;
+      signed char fromDir;
     };
 
     // Each cell of the dpa matrix has 3 states, one for
@@ -80,10 +127,82 @@ class DPAlinear
     // Store the final alignment here - in reverse!
     char *alignment;
     int alignPos;
+    int printAlign;		// Print it, else see takeAlignment()
 
     int debugPrint;
 
+    int local;			// Smith-Waterman local alignment, see doLocalDPA()
+
+    Score big;			// Infinity.  Half the range of a Score
+    volatile int overflow;	// Set when a cost does not fit in a Score
+
+    // Tiled wavefront.  The tiles of one pass are handed to a
+    // pool of threads as soon as the tile above and the tile to
+    // the left are done.  Tiles only exchange their boundaries:
+    // hrow[] holds the last row done for each column, and
+    // vcol[] holds the last column done (plus the corner above
+    // it) for each row of tiles.
+    int numThreads;
+    pthread_t *threads;
+    pthread_mutex_t poolLock;
+    pthread_cond_t poolWake;
+    int poolShutdown;
+
+    struct dpaElem *hrow;
+    struct dpaElem *vcol;
+    struct dpaElem *vbound;	// Last column done for each row (not tiled)
+
+    int tileRows, tileCols;	// Number of tiles in the current pass
+    int *tilesDone;		// Tiles done so far in each row of tiles
+    int *ready;			// Stack of tiles (row of tile) ready to go
+    int numReady, numDone;
+
+    // Bounds of the current pass (read by the tile threads)
+    int pStart_i, pStart_j, pFinish_i, pFinish_j, pCheckRow;
+
+    // The diagonals (i-pStart_i)-(j-pStart_j) of the current pass
+    // that an alignment of its cost can be on, see setBand().  Cells
+    // off them are set to 'outside' and not calculated.
+    int pBandLo, pBandHi;
+    struct dpaElem outside;
+
+    // With -p, the most the current pass can cost, and whether its
+    // states are pruned against it, see pruned()
+    long long pBound;
+    int pPrune;
+    long long topBound;		// The cost of some alignment of A and B
+
+    Score *checkCost;		// Cost of each state of the check-point row,
+				// at checkCost[j*3+dir]
+
+    void *stripeBuf;		// Rows for stripedPass(), if it is used
+
+    int *rowProfile;		// MatrixCosts only.  The query profile: for
+				// each residue code, the diag cost against
+				// each column of B.  Row code is at
+				// rowProfile[code*(lenB+1)], see profRow().
+
   private:
+
+    // profRow(c) - the profile row for the char c of A.  Indexed by
+    // column of B, from 1.
+    const int *profRow(char c)
+    {
+      return &rowProfile[SubMatrix::code[(unsigned char)c] * (long)(lenB+1)];
+    }
+
+    // makeProfile() - fill in rowProfile[], once for the whole
+    // alignment.  Every pass reads its columns from it.
+    void makeProfile()
+    {
+      rowProfile = new int[SubMatrix::nCodes * (long)(lenB+1)];
+      for (int c=0; c<SubMatrix::nCodes; c++) {
+        int *row = &rowProfile[c * (long)(lenB+1)];
+        row[0] = 0;
+        for (int j=1; j<=lenB; j++)
+          row[j] = SubMatrix::cost[c][SubMatrix::code[(unsigned char)B[j-1]]];
+      }
+    }
  
     // cellCalc(state, from, addCosts[]) - critical routine
     // that fills in 1 'state' of a cell in the DPA matrix.
@@ -97,94 +216,712 @@ class DPAlinear
     // the crossing column, and state, of the check-point
     // row can be determined.
     void cellCalc(struct stateType &state, const struct dpaElem &from, int addCosts[3]) {
-      int c[3];
+      typename WideScore<Score>::type c[3];
       for (int i=0; i<3; i++)
-        c[i] = from.d[i].cost + addCosts[i];
+        c[i] = (typename WideScore<Score>::type)from.d[i].cost + addCosts[i];
 
       int i = MINDIR3(c[horz], c[vert], c[diag]);
 
+      if (c[i] >= big || c[i] <= -big) {
+        if (from.d[i].cost >= big) {	// Only reached from outside the band
+          state.cost = big;
+          return;
+        }
+        overflow = 1;
+      }
       state.cost = c[i];
       state.fromCol = from.d[i].fromCol;
       state.fromDir = from.d[i].fromDir;
     }
 
+    // calcCell(cur, prev, c, i, j) - fill in the 3 states of
+    // cell (i,j) of the current pass, which is cur[c].  The row
+    // above is prev[].  Used by both the row by row sweep and
+    // the tiles so they give exactly the same results.
+    void calcCell(struct dpaElem *cur, const struct dpaElem *prev,
+                  int c, int i, int j)
+    {
+      int addCosts[3];
+      struct dpaElem &cell = cur[c];
+
+      // Calculate the horizontal state (delete a char from strA)
+      if (j>pStart_j) {
+        addCosts[horz] = Cost::b;                          // Continue a horizontal gap
+        addCosts[vert] = addCosts[diag] = Cost::a+Cost::b; // Start a horizontal gap
+        cellCalc(cell.d[horz], cur[c-1], addCosts);
+      } else
+        cell.d[horz].cost = big;
+
+      // Calculate the vertical state (delete a char from strB)
+      if (i>pStart_i) {
+        addCosts[vert] = Cost::b;                          // Continue a vertical gap
+        addCosts[horz] = addCosts[diag] = Cost::a+Cost::b; // Start a vertical gap
+        cellCalc(cell.d[vert], prev[c], addCosts);
+      } else
+        cell.d[vert].cost = big;
+
+      // Calculate the diagonal state (match/mismatch)
+      if (i>pStart_i && j>pStart_j) {
+        addCosts[horz] = Cost::matrix ? profRow(A[i-1])[j] :
+          (A[i-1]==B[j-1]) ? Cost::MatchCost : Cost::MismatchCost;
+        addCosts[vert] = addCosts[diag] = addCosts[horz];
+        cellCalc(cell.d[diag], prev[c-1], addCosts);
+      } else
+        cell.d[diag].cost = big;
+
+      // If this is the check-point row, store the 'from' info
+      if (i==pCheckRow)
+        for (int dir=0; dir<3; dir++) {
+          cell.d[dir].fromCol = j;
+          cell.d[dir].fromDir = (direction)dir;
+          checkCost[j*3+dir] = cell.d[dir].cost;
+        }
+    }
+
+    // outOfBand(i0,i1, j0,j1) - true if no cell of the block is
+    // on a diagonal of the band.
+    int outOfBand(int i0, int i1, int j0, int j1)
+    {
+      return (i1-pStart_i) - (j0-pStart_j) < pBandLo ||
+             (i0-pStart_i) - (j1-pStart_j) > pBandHi;
+    }
+
+    // skipBlock(i0,i1, j0,j1, col) - what calcBlock() leaves in
+    // hrow[] and col[] for a block that is all out of the band.
+    void skipBlock(int i0, int i1, int j0, int j1, struct dpaElem *col)
+    {
+      for (int j=j0; j<=j1; j++)
+        hrow[j] = outside;
+      for (int i=i0; i<=i1; i++)
+        col[i-i0] = outside;
+    }
+
+    // dead(e) - true if no state of cell e can be reached
+    int dead(const struct dpaElem &e)
+    {
+      return e.d[horz].cost >= big && e.d[vert].cost >= big &&
+             e.d[diag].cost >= big;
+    }
+
+    // pruned(i, j, cost) - true if a path through cell (i,j) that
+    // costs 'cost' so far must cost more than pBound by the end of the
+    // pass.  The rest of it has N+M = 2*x + g, for x diag steps and g
+    // chars in gaps, and at least k = |N-M| of those are gaps.  So it
+    // costs at least (mmin*(N+M) + (2*b-mmin)*k)/2, as in bandGaps().
+    int pruned(int i, int j, Score cost)
+    {
+      long long mmin = MIN2(Cost::MatchCost, Cost::MismatchCost);
+      long long N = pFinish_i - i, M = pFinish_j - j;
+
+      return 2*(long long)cost + mmin*(N+M) + (2*Cost::b-mmin)*llabs(N-M) > 2*pBound;
+    }
+
+    // calcBlock(i0,i1, j0,j1, corner, col) - do one block of the
+    // current pass.  The row above comes from hrow[], the column
+    // to the left from col[] (col[0] is row i0) and the cell
+    // above and left of the block is 'corner'.  Both hrow[] and
+    // col[] are replaced by this block's last row and column.
+    // Only the cells in the band are calculated.  Returns the
+    // corner for the block to the right.
+    struct dpaElem calcBlock(int i0, int i1, int j0, int j1,
+                             const struct dpaElem &corner,
+                             struct dpaElem *col)
+    {
+      struct dpaElem rows[2][TILE_SIZE+1];  // [0] is the column to the left
+      int w = j1 - j0 + 1;
+      int c;
+
+      struct dpaElem nextCorner = hrow[j1];
+      if (outOfBand(i0, i1, j0, j1)) {
+        skipBlock(i0, i1, j0, j1, col);
+        return nextCorner;
+      }
+
+      struct dpaElem *prev = rows[0], *cur = rows[1];
+      long cells = 0, pruneCells = 0, skipCells = 0;
+      prev[0] = corner;
+      for (c=1; c<=w; c++)
+        prev[c] = hrow[j0+c-1];
+
+      for (int i=i0; i<=i1; i++) {
+        // Columns c of this row in the band
+        int cLo = (i-pStart_i) - pBandHi + pStart_j - j0 + 1;
+        int cHi = MIN2(w, (i-pStart_i) - pBandLo + pStart_j - j0 + 1);
+
+        cur[0] = col[i-i0];
+        for (c=1; c<cLo && c<=w; c++)
+          cur[c] = outside;
+        for (; c<=cHi; c++) {
+          int j = j0+c-1;
+          if (i==pStart_i && j==pStart_j) {
+            cur[c] = prev[c];	// Start state already initialised.
+            continue;
+          }
+          if (!pPrune) {
+            calcCell(cur, prev, c, i, j);
+            continue;
+          }
+
+          // Nothing reaches a cell with no live cell before it
+          if (dead(cur[c-1]) && dead(prev[c-1]) && dead(prev[c])) {
+            cur[c] = outside;
+            if (i==pCheckRow)
+              for (int dir=0; dir<3; dir++)
+                checkCost[j*3+dir] = big;
+            skipCells++;
+            continue;
+          }
+
+          calcCell(cur, prev, c, i, j);
+          cells++;
+          int live = 0;
+          for (int dir=0; dir<3; dir++)
+            if (cur[c].d[dir].cost < big) {
+              if (pruned(i, j, cur[c].d[dir].cost))
+                cur[c].d[dir].cost = big;
+              else
+                live = 1;
+            }
+          if (!live)
+            pruneCells++;
+        }
+        for (; c<=w; c++)
+          cur[c] = outside;
+        col[i-i0] = cur[w];
+        struct dpaElem *t = prev; prev = cur; cur = t;
+      }
+
+      for (c=1; c<=w; c++)
+        hrow[j0+c-1] = prev[c];
+      if (pPrune) {		// Blocks may be on several threads
+        __sync_fetch_and_add(&cellCount, cells);
+        __sync_fetch_and_add(&pruneCount, pruneCells);
+        __sync_fetch_and_add(&skipCount, skipCells);
+      }
+      return nextCorner;
+    }
+
+    // calcTile(ti, tj) - do one tile of the wavefront.  vcol[]
+    // keeps the corner and left column for each row of tiles.
+    void calcTile(int ti, int tj)
+    {
+      struct dpaElem *col = &vcol[ti*(TILE_SIZE+1)];
+      int i0 = pStart_i + ti*TILE_SIZE, i1 = i0 + TILE_SIZE - 1;
+      int j0 = pStart_j + tj*TILE_SIZE, j1 = j0 + TILE_SIZE - 1;
+      if (i1 > pFinish_i) i1 = pFinish_i;
+      if (j1 > pFinish_j) j1 = pFinish_j;
+
+      col[0] = calcBlock(i0, i1, j0, j1, col[0], &col[1]);
+    }
+
+    // runTiles() - take ready tiles until the whole pass is done.
+    // Run by the pool threads, and by the caller of tiledPass().
+    void runTiles(int forever)
+    {
+      pthread_mutex_lock(&poolLock);
+      while (1) {
+        while (numReady==0 && !poolShutdown &&
+               (forever || numDone < tileRows*tileCols))
+          pthread_cond_wait(&poolWake, &poolLock);
+        if (poolShutdown || (!forever && numDone == tileRows*tileCols))
+          break;
+
+        int ti = ready[--numReady];
+        int tj = tilesDone[ti];
+        pthread_mutex_unlock(&poolLock);
+
+        calcTile(ti, tj);
+
+        pthread_mutex_lock(&poolLock);
+        tilesDone[ti]++;
+        numDone++;
+        // The tile to the right needs the row of tiles above to be past it
+        if (tj+1 < tileCols && (ti==0 || tilesDone[ti-1] > tj+1))
+          ready[numReady++] = ti;
+        // The tile below may have been waiting on this one
+        if (ti+1 < tileRows && tilesDone[ti+1] == tj)
+          ready[numReady++] = ti+1;
+        pthread_cond_broadcast(&poolWake);
+      }
+      pthread_mutex_unlock(&poolLock);
+    }
+
+    static void *poolThread(void *arg) {
+      ((DPAlinear *)arg)->runTiles(1);
+      return NULL;
+    }
+
+    // initPass(sDir) - set the row above the current pass.  It is
+    // never used, except for the start state on the first row.
+    void initPass(direction sDir)
+    {
+      for (int j=pStart_j; j<=pFinish_j; j++)
+        for (int dir=0; dir<3; dir++)
+          hrow[j].d[dir].cost = big;
+      for (int dir=0; dir<3; dir++)
+        hrow[pStart_j].d[dir].cost = (dir == sDir ? 0 : big);
+    }
+
+    // recursivePass(i0,i1, j0,j1, corner) - a cache-oblivious
+    // traversal of the current pass.  The longer side is halved
+    // until the block is small, so at every scale the block
+    // being worked on, and its boundary in hrow[] and vbound[],
+    // fit in the cache.
+    void recursivePass(int i0, int i1, int j0, int j1,
+                       const struct dpaElem &corner)
+    {
+      if (outOfBand(i0, i1, j0, j1)) {
+        skipBlock(i0, i1, j0, j1, &vbound[i0]);
+      } else if (i1-i0 < BLOCK_SIZE && j1-j0 < BLOCK_SIZE) {
+        calcBlock(i0, i1, j0, j1, corner, &vbound[i0]);
+      } else if (i1-i0 >= j1-j0) {
+        int mid = (i0+i1)/2;
+        struct dpaElem corner2 = vbound[mid];	// Save before top half is done
+        recursivePass(i0, mid, j0, j1, corner);
+        recursivePass(mid+1, i1, j0, j1, corner2);
+      } else {
+        int mid = (j0+j1)/2;
+        struct dpaElem corner2 = hrow[mid];	// Save before left half is done
+        recursivePass(i0, i1, j0, mid, corner);
+        recursivePass(i0, i1, mid+1, j1, corner2);
+      }
+    }
+
+#ifdef __SSE2__
+    // stripedPass(sDir, final) - the same pass as recursivePass()
+    // done with SIMD, for the Score types that can be.  Only 16 bit
+    // Scores can, the (Score *) argument picks the short version,
+    // see below.  Returns 0 if it was not done.  Without SSE2 there
+    // is no striped pass, and doPass() never asks for one.
+    int stripedPass(direction sDir, struct dpaElem &final)
+    {
+      return stripedPass((Score *)0, sDir, final);
+    }
+    int stripedPass(void *, direction, struct dpaElem &)
+    {
+      return 0;
+    }
+
+    // Striped SSE2 pass for 16 bit scores.  Column pStart_j+1+l*segLen+k
+    // is in lane l of vector k (M. Farrar, Bioinformatics, 2007, 23:2,
+    // pp 156-161), and each state has a vector of costs and a vector of
+    // where it came from on the check-point row, coded as
+    // (fromCol-pStart_j)*3 + fromDir.  The 'from' vectors are carried
+    // along with and/andnot/or blends on the same masks that choose the
+    // cost.  They are only needed after the check-point row.  The first
+    // row and the first column are done by calcCell(), as before.
+    // With a matrix, the diag costs come from a striped copy of this
+    // pass's columns of rowProfile[], made the first time a residue
+    // turns up in A, so it is never bigger than the pass.
+
+    int stripedPass(short *, direction sDir, struct dpaElem &final)
+    {
+      int i, k, l, s;
+      int w = pFinish_j - pStart_j;		// Columns after the first
+      int segLen = (w + LANES-1)/LANES;
+
+      // Narrow passes are not worth it, and 'from' must fit in 16 bits
+      if (w < 2*LANES || w*3+2 > 0xffff)
+        return 0;
+      if (Cost::a+Cost::b >= big || Cost::a+Cost::b <= -big ||
+          Cost::b >= big || Cost::b <= -big ||
+          Cost::MatchCost >= big || Cost::MatchCost <= -big ||
+          Cost::MismatchCost >= big || Cost::MismatchCost <= -big)
+        return 0;
+
+      // Enough for the widest pass, so it is only allocated once
+      const int NVEC = 16 + (Cost::matrix ? SubMatrix::nCodes : 0);
+      if (!stripeBuf) {
+        stripeBuf = _mm_malloc(NVEC * ((lenB+LANES-1)/LANES) * sizeof(__m128i), 16);
+        if (!stripeBuf) { cerr << "Unable to allocate memory" << endl; exit(-1); }
+      }
+      __m128i *p[6], *c[6];		// Previous and this row.  Costs, then 'from'
+      __m128i *v = (__m128i *)stripeBuf;
+      for (s=0; s<6; s++) {
+        p[s] = v; v += segLen;
+        c[s] = v; v += segLen;
+      }
+      __m128i *hWins = v; v += segLen;	// Lanes where horz came from horz
+      __m128i *chB = v; v += segLen;	// The chars of B
+      __m128i *valid = v; v += segLen;	// Lanes that are real columns
+      __m128i *stamp = v; v += segLen;	// 'from' of each column's horz state
+      __m128i *profile[MAXCODES];		// Striped profile, per residue code
+      short *lane;
+
+      for (k=0; k<MAXCODES; k++)
+        profile[k] = NULL;
+
+      for (k=0; k<segLen; k++) {
+        short *cb = (short *)&chB[k], *ok = (short *)&valid[k], *st = (short *)&stamp[k];
+        for (l=0; l<LANES; l++) {
+          int j = l*segLen + k + 1;
+          cb[l] = (j<=w ? (unsigned char)B[pStart_j+j-1] : -1);
+          ok[l] = (j<=w ? -1 : 0);
+          st[l] = (j<=w ? j*3 : 0);
+        }
+      }
+
+      // The first row is only horz moves from the start
+      initPass(sDir);
+      for (int j=pStart_j+1; j<=pFinish_j; j++)
+        calcCell(hrow, hrow, j, pStart_i, j);
+      for (k=0; k<segLen; k++)
+        for (s=0; s<3; s++) {
+          lane = (short *)&p[s][k];
+          for (l=0; l<LANES; l++) {
+            int j = l*segLen + k + 1;
+            lane[l] = (j<=w ? hrow[pStart_j+j].d[s].cost : big);
+          }
+          p[s+3][k] = _mm_setzero_si128();
+        }
+      struct dpaElem p0 = hrow[pStart_j], c0;	// Column pStart_j
+      short pm0[3], cm0[3];				// and its 'from'
+      for (s=0; s<3; s++)
+        pm0[s] = 0;
+
+      const __m128i vB = _mm_set1_epi16(Cost::b);
+      const __m128i vAB = _mm_set1_epi16(Cost::a+Cost::b);
+      const __m128i vMatch = _mm_set1_epi16(Cost::MatchCost);
+      const __m128i vMismatch = _mm_set1_epi16(Cost::MismatchCost);
+      __m128i ov = _mm_setzero_si128();
+
+      for (i=pStart_i+1; i<=pFinish_i; i++) {
+        int carryFrom = (i > pCheckRow);
+        __m128i chA = _mm_set1_epi16((unsigned char)A[i-1]);
+        __m128i m, t, f, lH, lV, lD, lmH, lmV, lmD;
+        __m128i *prof = NULL;
+
+        if (Cost::matrix) {
+          int code = SubMatrix::code[(unsigned char)A[i-1]];
+          if (!profile[code]) {
+            const int *row = profRow(A[i-1]);
+            profile[code] = v; v += segLen;
+            for (k=0; k<segLen; k++) {
+              lane = (short *)&profile[code][k];
+              for (l=0; l<LANES; l++) {
+                int j = l*segLen + k + 1;
+                lane[l] = (j<=w ? row[pStart_j+j] : Cost::MismatchCost);
+              }
+            }
+          }
+          prof = profile[code];
+        }
+
+        calcCell(&c0, &p0, 0, i, pStart_j);
+        for (s=0; s<3; s++)
+          cm0[s] = (c0.d[s].fromCol - pStart_j)*3 + c0.d[s].fromDir;
+
+        // vert and diag, which only need the previous row
+        __m128i ulH = shiftIn(p[horz][segLen-1], p0.d[horz].cost);
+        __m128i ulV = shiftIn(p[vert][segLen-1], p0.d[vert].cost);
+        __m128i ulD = shiftIn(p[diag][segLen-1], p0.d[diag].cost);
+        __m128i ulmH = shiftIn(p[3+horz][segLen-1], pm0[horz]);
+        __m128i ulmV = shiftIn(p[3+vert][segLen-1], pm0[vert]);
+        __m128i ulmD = shiftIn(p[3+diag][segLen-1], pm0[diag]);
+        for (k=0; k<segLen; k++) {
+          c[vert][k] = pick3(_mm_adds_epi16(p[horz][k], vAB),
+                             _mm_adds_epi16(p[vert][k], vB),
+                             _mm_adds_epi16(p[diag][k], vAB),
+                             p[3+horz][k], p[3+vert][k], p[3+diag][k], &m);
+          c[3+vert][k] = m;
+
+          if (Cost::matrix)
+            t = prof[k];
+          else {
+            t = _mm_cmpeq_epi16(chA, chB[k]);
+            t = _mm_or_si128(_mm_and_si128(t, vMatch), _mm_andnot_si128(t, vMismatch));
+          }
+          c[diag][k] = _mm_adds_epi16(pick3(ulH, ulV, ulD, ulmH, ulmV, ulmD, &m), t);
+          c[3+diag][k] = m;
+
+          ulH = p[horz][k]; ulV = p[vert][k]; ulD = p[diag][k];
+          ulmH = p[3+horz][k]; ulmV = p[3+vert][k]; ulmD = p[3+diag][k];
+        }
+
+        // horz, first ignoring the carry between lanes
+        lH = shiftIn(_mm_set1_epi16(big), c0.d[horz].cost);
+        lV = shiftIn(c[vert][segLen-1], c0.d[vert].cost);
+        lD = shiftIn(c[diag][segLen-1], c0.d[diag].cost);
+        for (k=0; k<segLen; k++) {
+          c[horz][k] = _mm_min_epi16(_mm_adds_epi16(lH, vB),
+                                     _mm_adds_epi16(_mm_min_epi16(lV, lD), vAB));
+          lH = c[horz][k]; lV = c[vert][k]; lD = c[diag][k];
+        }
+
+        // Lazy-F: carry horz from the last vector into the next lane up,
+        // until it no longer improves anything
+        f = _mm_adds_epi16(shiftIn(c[horz][segLen-1], big), vB);
+        for (l=0; l<LANES; l++) {
+          for (k=0; k<segLen; k++) {
+            if (!_mm_movemask_epi8(_mm_cmplt_epi16(f, c[horz][k])))
+              goto horzDone;
+            c[horz][k] = _mm_min_epi16(c[horz][k], f);
+            f = _mm_adds_epi16(c[horz][k], vB);
+          }
+          f = shiftIn(f, big);
+        }
+      horzDone:
+
+        if (carryFrom) {
+          // Now the costs are final, find which lanes took horz from horz
+          // (ties go to horz), and carry its 'from' along the row the
+          // same way as the costs.
+          lH = shiftIn(c[horz][segLen-1], c0.d[horz].cost);
+          lV = shiftIn(c[vert][segLen-1], c0.d[vert].cost);
+          lD = shiftIn(c[diag][segLen-1], c0.d[diag].cost);
+          lmV = shiftIn(c[3+vert][segLen-1], cm0[vert]);
+          lmD = shiftIn(c[3+diag][segLen-1], cm0[diag]);
+          lmH = shiftIn(_mm_setzero_si128(), cm0[horz]);
+          for (k=0; k<segLen; k++) {
+            __m128i h = _mm_adds_epi16(lH, vB);
+            hWins[k] = _mm_andnot_si128(
+              _mm_or_si128(_mm_cmpgt_epi16(h, _mm_adds_epi16(lV, vAB)),
+                           _mm_cmpgt_epi16(h, _mm_adds_epi16(lD, vAB))),
+              _mm_set1_epi32(-1));
+            pick3(h, _mm_adds_epi16(lV, vAB), _mm_adds_epi16(lD, vAB),
+                  lmH, lmV, lmD, &m);
+            c[3+horz][k] = m;
+            lH = c[horz][k]; lV = c[vert][k]; lD = c[diag][k];
+            lmH = m; lmV = c[3+vert][k]; lmD = c[3+diag][k];
+          }
+          f = shiftIn(c[3+horz][segLen-1], cm0[horz]);
+          for (l=0; l<LANES; l++) {
+            for (k=0; k<segLen; k++) {
+              m = _mm_or_si128(_mm_and_si128(hWins[k], f),
+                               _mm_andnot_si128(hWins[k], c[3+horz][k]));
+              if (_mm_movemask_epi8(_mm_cmpeq_epi16(m, c[3+horz][k])) == 0xffff)
+                goto fromDone;
+              c[3+horz][k] = f = m;
+            }
+            f = shiftIn(f, cm0[horz]);
+          }
+        fromDone: ;
+        } else if (i == pCheckRow) {
+          for (k=0; k<segLen; k++)
+            for (s=0; s<3; s++) {
+              c[3+s][k] = _mm_add_epi16(stamp[k], _mm_set1_epi16(s));
+              lane = (short *)&c[s][k];
+              for (l=0; l<LANES; l++) {
+                int j = l*segLen + k + 1;
+                if (j<=w)
+                  checkCost[(pStart_j+j)*3+s] = lane[l];
+              }
+            }
+        }
+
+        for (k=0; k<segLen; k++)
+          ov = _mm_or_si128(ov, _mm_and_si128(valid[k],
+                 _mm_or_si128(outOfRange(c[horz][k], big),
+                              _mm_or_si128(outOfRange(c[vert][k], big),
+                                           outOfRange(c[diag][k], big)))));
+
+        for (s=0; s<6; s++) {
+          __m128i *x = p[s]; p[s] = c[s]; c[s] = x;
+        }
+        p0 = c0;
+        for (s=0; s<3; s++)
+          pm0[s] = cm0[s];
+      }
+
+      if (_mm_movemask_epi8(ov))
+        overflow = 1;
+
+      k = (w-1)%segLen;
+      l = (w-1)/segLen;
+      for (s=0; s<3; s++) {
+        unsigned short from = ((unsigned short *)&p[3+s][k])[l];
+        final.d[s].cost = ((short *)&p[s][k])[l];
+        final.d[s].fromCol = pStart_j + from/3;
+        final.d[s].fromDir = from%3;
+      }
+      return 1;
+    }
+#endif
+
+    // tiledPass() - the same pass as recursivePass(), but done as
+    // a wavefront of tiles on the thread pool.  Returns the final
+    // cell.
+    struct dpaElem tiledPass(direction sDir)
+    {
+      initPass(sDir);
+
+      pthread_mutex_lock(&poolLock);
+      tileRows = (pFinish_i - pStart_i)/TILE_SIZE + 1;
+      tileCols = (pFinish_j - pStart_j)/TILE_SIZE + 1;
+      for (int t=0; t<tileRows; t++)
+        tilesDone[t] = 0;
+      numDone = 0;
+      numReady = 0;
+      ready[numReady++] = 0;
+      pthread_cond_broadcast(&poolWake);
+      pthread_mutex_unlock(&poolLock);
+
+      runTiles(0);
+
+      return hrow[pFinish_j];
+    }
+
+    // bandGaps(cost) - the most chars in gaps an alignment of the
+    // current pass can have if it costs no more than 'cost'.  With x
+    // diag steps and g chars in gaps, 2*x + g = n + m, and each diag
+    // step costs at least the least of MatchCost and MismatchCost
+    // (mmin), each gap char at least b.  So
+    //   2*cost >= mmin*(n+m) + (2*b-mmin)*g
+    // Returns -1 if the costs give no such bound.
+    long long bandGaps(long long cost)
+    {
+      long long mmin = MIN2(Cost::MatchCost, Cost::MismatchCost);
+      long long nm = (pFinish_i - pStart_i) + (pFinish_j - pStart_j);
+
+      if (cost == UNKNOWN_COST || Cost::a < 0 || Cost::b < 0 || 2*Cost::b <= mmin)
+        return -1;
+      return (2*cost - mmin*nm) / (2*Cost::b - mmin);
+    }
+
+    // setBand(g) - limit the current pass to the diagonals that an
+    // alignment with at most g chars in gaps can get to.  One on
+    // diagonal k has at least |k| + |k-(n-m)| of them.  g<0 is no
+    // limit.  Returns 1 if the band is narrower than the pass.
+    int setBand(long long g)
+    {
+      int n = pFinish_i - pStart_i, m = pFinish_j - pStart_j;
+      int d = n - m;
+
+      pBandLo = -m;
+      pBandHi = n;
+      if (g < 0 || g >= n + m)
+        return 0;
+      int spare = (int)(MAX2(g, (long long)abs(d)) - abs(d)) / 2;
+      pBandLo = MAX2(pBandLo, MIN2(0, d) - spare);
+      pBandHi = MIN2(pBandHi, MAX2(0, d) + spare);
+      return 1;
+    }
+
+    // doPass(sDir, gaps, final) - one pass over the current
+    // rectangle, in the band for 'gaps' (see setBand()).  A narrow
+    // band is done by recursivePass(), as only its blocks need be
+    // touched, and a wide one by stripedPass() if it can (but not
+    // when pruning, which only calcBlock() does).  Returns
+    // 1 if the pass was limited to the band.
+    int doPass(direction sDir, long long gaps, struct dpaElem &final)
+    {
+      int banded = setBand(gaps);
+      int w = pFinish_j - pStart_j + 1;
+
+      if (numThreads > 1 &&
+          (long)(pFinish_i-pStart_i+1)*w >= TILE_MIN_CELLS) {
+        // Big enough to share among the threads
+        final = tiledPass(sDir);
+        return banded;
+      }
+#ifdef __SSE2__
+      if (!pPrune && (!banded || (pBandHi-pBandLo+1)*BAND_STRIPED > w) &&
+          stripedPass(sDir, final))
+        return 0;
+#endif
+      initPass(sDir);
+      recursivePass(pStart_i, pFinish_i, pStart_j, pFinish_j, hrow[pStart_j]);
+      final = hrow[pFinish_j];
+      return banded;
+    }
+
     // The DPA with check-pointing recursion to recover an
     // alignment.  Note: on first call eDir==any because the
     // final state of the alignment is not constrained.  All
     // subsequent calls will have eDir set to a proper
-    // value.  sDir==diag on the first call.
-    int doDPA(
+    // value.  sDir==diag on the first call.  Gives up as soon
+    // as a pass overflows.
+    //
+    // 'cost' is the cost of the alignment, if the caller knows it
+    // (every recursive call does), and each pass is limited to the
+    // band of diagonals that cost allows.  When it is UNKNOWN_COST
+    // the band starts narrow and doubles until the cost found fits
+    // in it (E. Ukkonen, "Algorithms for approximate string
+    // matching", Information and Control, 1985, 64, pp 100-118),
+    // so similar strings take O(n*d) rather than O(n*n).
+    long long doDPA(
         int start_i, int start_j,   direction sDir,
-        int finish_i, int finish_j, direction eDir)
+        int finish_i, int finish_j, direction eDir,
+        long long cost)
     {
       int checkRow;   // Index of row to check-point
       int i,j;
+      struct dpaElem final;
 
       checkRow  = (finish_i - start_i + 1)/2 + start_i;
 
-      // Initialise starting state (based on sDir)
-      for (int dir=0; dir<3; dir++)
-        data[start_i%2][start_j].d[dir].cost = (dir == sDir ? 0 : BIG_VAL);
-
-      // Iterate over the DPA matrix
-      for (i=start_i; i<=finish_i; i++) {
-        for (j=start_j; j<=finish_j; j++) {
-
-          int addCosts[3];
-
-          if (i==start_i && j==start_j)
-            continue;    // Start state already initialised.
-
-          // Calculate the horizontal state (delete a char from strA)
-          if (j>start_j) {
-            addCosts[horz] = b;                      // Continue a horizontal gap
-            addCosts[vert] = addCosts[diag] = a+b;   // Start a horizontal gap
-            cellCalc(data[i%2][j].d[horz], data[i%2][j-1], addCosts);
-          } else
-            data[i%2][j].d[horz].cost = BIG_VAL;
-
-          // Calculate the vertical state (delete a char from strB)
-          if (i>start_i) {
-            addCosts[vert] = b;                    // Continue a vertical gap
-            addCosts[horz] = addCosts[diag] = a+b; // Start a vertical gap
-            cellCalc(data[i%2][j].d[vert], data[(i-1)%2][j], addCosts);
-          } else
-            data[i%2][j].d[vert].cost = BIG_VAL;
-
-          // Calculate the diagonal state (match/mismatch)
-          if (i>start_i && j>start_j) {
-            addCosts[horz] = (A[i-1]==B[j-1]) ? MatchCost : MismatchCost;
-            addCosts[vert] = addCosts[diag] = addCosts[horz];
-            cellCalc(data[i%2][j].d[diag], data[(i-1)%2][j-1], addCosts);
-          } else
-            data[i%2][j].d[diag].cost = BIG_VAL;
-    
-          if (debugPrint) printf("\n(%d,%d) H=%d V=%d D=%d", i,j,data[i%2][j].d[horz].cost,data[i%2][j].d[vert].cost,data[i%2][j].d[diag].cost);
+      pStart_i  = start_i;  pStart_j  = start_j;
+      pFinish_i = finish_i; pFinish_j = finish_j;
+      pCheckRow = checkRow;
 
-          // If this is the check-point row, store the 'from' info
-          if (i==checkRow)
-            for (int dir=0; dir<3; dir++) {
-              data[i%2][j].d[dir].fromCol = j;
-              data[i%2][j].d[dir].fromDir = (direction)dir;
-            }
+      // The known cost, or at the top that of some alignment, bounds
+      // every path worth finding.  The bound needs a, b >= 0 and
+      // 2*b >= mmin, as for the band.
+      pBound = (cost != UNKNOWN_COST ? cost : topBound);
+      pPrune = prune && bandGaps(0) >= 0;
+
+      if (finish_i - start_i > 1) {
+        long long gaps = bandGaps(cost);
+        int d = abs((finish_i - start_i) - (finish_j - start_j));
+
+        if (cost != UNKNOWN_COST || bandGaps(0) < 0) {
+          doPass(sDir, gaps, final);
+        } else {
+          // The cost found in a band is never less than the real one,
+          // so the band it allows always holds the real alignment
+          gaps = d + 2;
+          while (doPass(sDir, gaps, final) && !overflow) {
+            direction dir = (eDir < 0 ? MINDIR3(final.d[horz].cost,
+                                                final.d[vert].cost,
+                                                final.d[diag].cost) : eDir);
+            long long need = bandGaps(final.d[dir].cost);
+            if (need <= gaps)
+              break;
+            gaps = MIN2(2*gaps, need);
+          }
         }
+      } else {
+        // Only 1 or 2 rows, which the traceback below needs in data[]
+        // Initialise starting state (based on sDir)
+        for (int dir=0; dir<3; dir++)
+          data[start_i%2][start_j].d[dir].cost = (dir == sDir ? 0 : big);
+
+        // Iterate over the DPA matrix
+        for (i=start_i; i<=finish_i; i++) {
+          for (j=start_j; j<=finish_j; j++) {
+
+            if (i==start_i && j==start_j)
+              continue;    // Start state already initialised.
+
+            calcCell(data[i%2], data[(i+1)%2], j, i, j);
+
+            if (debugPrint) printf("\n(%d,%d) H=%lld V=%lld D=%lld", i,j,(long long)data[i%2][j].d[horz].cost,(long long)data[i%2][j].d[vert].cost,(long long)data[i%2][j].d[diag].cost);
+          }
+        }
+        final = data[finish_i%2][finish_j];
       }
 
+      if (overflow)
+        return 0;
 
       if (eDir < 0)  // Determine the end state if our caller did not set it.
-        eDir = MINDIR3(data[finish_i%2][finish_j].d[horz].cost,
-                       data[finish_i%2][finish_j].d[vert].cost,
-                       data[finish_i%2][finish_j].d[diag].cost);
+        eDir = MINDIR3(final.d[horz].cost,
+                       final.d[vert].cost,
+                       final.d[diag].cost);
 
-      int editDist = data[finish_i%2][finish_j].d[eDir].cost;  // Final edit cost
+      long long editDist = final.d[eDir].cost;  // Final edit cost
 
       if (finish_i - start_i > 1) {
         // More than 2 rows in matrix.  Recurse to find alignment
-        int split_j = data[finish_i%2][finish_j].d[eDir].fromCol;
-        direction split_dir = data[finish_i%2][finish_j].d[eDir].fromDir;
+        int split_j = final.d[eDir].fromCol;
+        direction split_dir = (direction)final.d[eDir].fromDir;
+        long long topCost = checkCost[split_j*3+split_dir];
 
-        doDPA(checkRow, split_j, split_dir, finish_i, finish_j, eDir);
-        doDPA(start_i, start_j, sDir, checkRow, split_j, split_dir);
+        doDPA(checkRow, split_j, split_dir, finish_i, finish_j, eDir,
+              editDist - topCost);
+        if (overflow)
+          return 0;
+        doDPA(start_i, start_j, sDir, checkRow, split_j, split_dir, topCost);
       } else {
         // Determine alignment directly from 'data'.  Only 1 or 2 rows
         i = finish_i;
@@ -192,7 +929,7 @@ class DPAlinear
         direction dir = eDir;
         int all_horz = (i == start_i);  // all_horz - true when only 1 row in this step
         while (i != start_i || j != start_j) {
-          int val;
+          long long val;
           char c1,c2;
           switch (dir) {
           case vert:
@@ -212,9 +949,9 @@ class DPAlinear
             val = data[i%2][j].d[horz].cost;
             j--;
 
-            if (all_horz || val == data[i%2][j].d[horz].cost + b)
+            if (all_horz || val == (long long)data[i%2][j].d[horz].cost + Cost::b)
               dir = horz;
-            else if (val == data[i%2][j].d[vert].cost + a + b)
+            else if (val == (long long)data[i%2][j].d[vert].cost + Cost::a + Cost::b)
               dir = vert;
             else
               dir = diag;
@@ -230,21 +967,239 @@ class DPAlinear
       return editDist;
     }
 
-    int doCheckpDPA ()  
+    // simpleCost() - the cost of A and B aligned char by char from
+    // the start, with what is left of the longer in one gap at the
+    // end.  No better than that is an upper bound for -p.
+    long long simpleCost()
     {
-      int i,res;
+      long long c = 0;
+      int n = MIN2(lenA, lenB), k = abs(lenA - lenB);
+
+      for (int i=0; i<n; i++)
+        c += Cost::matrix ? profRow(A[i])[i+1] :
+          (A[i]==B[i]) ? Cost::MatchCost : Cost::MismatchCost;
+      if (k > 0)
+        c += Cost::a + (long long)Cost::b*k;
+      return c;
+    }
+
+    long long doCheckpDPA ()  
+    {
+      int i;
+      long long res;
 
       //debugPrint=1;
-      res = doDPA(0, 0, diag, lenA, lenB, any);
+      if (prune)
+        topBound = simpleCost();
+      res = doDPA(0, 0, diag, lenA, lenB, any, UNKNOWN_COST);
+      if (overflow)
+        return 0;
+
+      if (printAlign)
+        for (i=alignPos-2; i>=0; i-=2)
+          printf("<%c,%c> ", alignment[i], alignment[i+1]);
+  
+      return res;
+    }
+
+    // For localPass(), a state also carries the cell its local
+    // alignment started from.
+    struct localState {
+      Score cost;
+      int startRow, startCol;
+    };
+
+    struct localElem {
+      struct localState d[3];
+    };
+
+    // localCalc(state, from, addCosts[]) - as cellCalc(), for
+    // localPass().  A state that costs 0 or more can not be part of
+    // a best local alignment (starting again after it would be no
+    // worse), so it is set to 'big'.  So every cost is negative, and
+    // only a cost that is too negative overflows.
+    void localCalc(struct localState &state, const struct localElem &from, int addCosts[3]) {
+      typename WideScore<Score>::type c[3];
+      for (int i=0; i<3; i++)
+        c[i] = (typename WideScore<Score>::type)from.d[i].cost + addCosts[i];
+
+      int i = MINDIR3(c[horz], c[vert], c[diag]);
+
+      if (from.d[i].cost >= big || c[i] >= 0) {
+        state.cost = big;
+        return;
+      }
+      if (c[i] <= -big)
+        overflow = 1;
+      state.cost = c[i];
+      state.startRow = from.d[i].startRow;
+      state.startCol = from.d[i].startCol;
+    }
+
+    // localPass(start_i,start_j, end_i,end_j) - score-only pass over
+    // the whole matrix (T. F. Smith and M. S. Waterman, "Identification
+    // of common molecular subsequences", J. Mol. Biol., 1981, 147,
+    // pp 195-197, with Gotoh's 3 states).  A local alignment may start
+    // at any cell with a diag step, so the diag state starts again
+    // whenever nothing before it is below 0.  Keeps one row, so space is
+    // O(n).  Returns the least cost of a diag state (or 0 if none is
+    // below 0), and sets where that state is and where it started.
+    long long localPass(int &start_i, int &start_j, int &end_i, int &end_j)
+    {
+      struct localElem *row = new struct localElem[lenB+1];
+      struct localElem left, upLeft, cur, none;
+      typename WideScore<Score>::type best = 0;
+      int addCosts[3];
+      int i, j, dir;
+
+      for (dir=0; dir<3; dir++)
+        none.d[dir].cost = big;
+      for (j=0; j<=lenB; j++)
+        row[j] = none;
+      start_i = start_j = end_i = end_j = 0;
+
+      for (i=1; i<=lenA; i++) {
+        const int *pRow = (Cost::matrix ? profRow(A[i-1]) : NULL);
+        left = upLeft = none;
+
+        for (j=1; j<=lenB; j++) {
+          const struct localElem &up = row[j];
+
+          addCosts[horz] = Cost::b;
+          addCosts[vert] = addCosts[diag] = Cost::a+Cost::b;
+          localCalc(cur.d[horz], left, addCosts);
+
+          addCosts[vert] = Cost::b;
+          addCosts[horz] = addCosts[diag] = Cost::a+Cost::b;
+          localCalc(cur.d[vert], up, addCosts);
+
+          int diagCost = Cost::matrix ? pRow[j] :
+            (A[i-1]==B[j-1]) ? Cost::MatchCost : Cost::MismatchCost;
+          addCosts[horz] = addCosts[vert] = addCosts[diag] = diagCost;
+          localCalc(cur.d[diag], upLeft, addCosts);
+          if (cur.d[diag].cost >= big && diagCost < 0) {
+            // Start again here
+            cur.d[diag].cost = diagCost;
+            cur.d[diag].startRow = i-1;
+            cur.d[diag].startCol = j-1;
+          }
+
+          if (cur.d[diag].cost < best) {
+            best = cur.d[diag].cost;
+            start_i = cur.d[diag].startRow;
+            start_j = cur.d[diag].startCol;
+            end_i = i;
+            end_j = j;
+          }
+
+          upLeft = up;
+          row[j] = left = cur;
+        }
+      }
+
+      delete[] row;
+      return best;
+    }
+
+    // doLocalDPA() - local alignment in O(n) space.  localPass()
+    // finds the best local alignment's end and start, then the
+    // check-pointing recursion finds a least cost alignment between
+    // the two, starting and finishing with a diag step.  That costs
+    // the same, or localPass() would have found a better one.
+    long long doLocalDPA()
+    {
+      int start_i, start_j, end_i, end_j;
+      int i;
+      long long res;
+
+      res = localPass(start_i, start_j, end_i, end_j);
+      if (overflow)
+        return 0;
+
+      if (res < 0) {
+        res = doDPA(start_i, start_j, diag, end_i, end_j, diag, res);
+        if (overflow)
+          return 0;
+        printf("Local alignment of A[%d..%d] and B[%d..%d]\n",
+               start_i+1, end_i, start_j+1, end_j);
+      } else
+        printf("No local alignment costs less than 0\n");
 
       for (i=alignPos-2; i>=0; i-=2)
         printf("<%c,%c> ", alignment[i], alignment[i+1]);
-  
+
       return res;
     }
   
 public:
-  int doAlign(char strA[], char strB[])
+  DPAlinear(int nThreads = 1, int localAlign = 0) :
+    local(localAlign), numThreads(nThreads), threads(NULL),
+    hrow(NULL), vcol(NULL), vbound(NULL), tilesDone(NULL), ready(NULL),
+    checkCost(NULL), stripeBuf(NULL), rowProfile(NULL)
+  {
+    big = numeric_limits<Score>::max()/2;
+    for (int dir=0; dir<3; dir++) {
+      outside.d[dir].cost = big;
+      outside.d[dir].fromCol = 0;
+      outside.d[dir].fromDir = dir;
+    }
+    overflow = 0;
+    pPrune = 0;
+    topBound = 0;
+    data[0] = NULL;
+    alignment = NULL;
+    printAlign = 1;
+  }
+
+  ~DPAlinear()
+  {
+    if (threads) {
+      pthread_mutex_lock(&poolLock);
+      poolShutdown = 1;
+      pthread_cond_broadcast(&poolWake);
+      pthread_mutex_unlock(&poolLock);
+      for (int t=0; t<numThreads-1; t++)
+        pthread_join(threads[t], NULL);
+      delete[] threads;
+    }
+    delete[] data[0];
+    delete[] alignment;
+    delete[] hrow;
+    delete[] vbound;
+    delete[] vcol;
+    delete[] tilesDone;
+    delete[] ready;
+    delete[] rowProfile;
+    delete[] checkCost;
+#ifdef __SSE2__
+    _mm_free(stripeBuf);
+#endif
+  }
+
+  // overflowed() - true if some cost did not fit in a Score, in
+  // which case nothing was printed and the result is meaningless.
+  int overflowed() { return overflow; }
+
+  // noPrint() - keep the (global) alignment for takeAlignment(),
+  // rather than printing it
+  void noPrint() { printAlign = 0; }
+
+  // takeAlignment(len) - the alignment found, in order, as pairs of
+  // chars.  Sets len to the number of pairs.  The caller must
+  // delete[] it.
+  char *takeAlignment(int &len)
+  {
+    char *pairs = new char[alignPos+1];
+
+    len = alignPos/2;
+    for (int i=0; i<alignPos; i+=2) {
+      pairs[i] = alignment[alignPos-2-i];
+      pairs[i+1] = alignment[alignPos-1-i];
+    }
+    return pairs;
+  }
+
+  long long doAlign(char strA[], char strB[])
   {
     struct dpaElem *tmp;
     
@@ -259,8 +1214,34 @@ public:
 
     alignment = new char[(lenA+lenB)*2];
     alignPos = 0;
+
+    hrow = new struct dpaElem[lenB+1];
+    vbound = new struct dpaElem[lenA+1];
+    checkCost = new Score[3 * (lenB+1)];
+
+    if (Cost::matrix)
+      makeProfile();
+
+    if (numThreads > 1) {
+      int maxTileRows = lenA/TILE_SIZE + 1;
+      vcol = new struct dpaElem[maxTileRows * (TILE_SIZE+1)];
+      tilesDone = new int[maxTileRows];
+      ready = new int[maxTileRows];
+
+      // Start the pool.  The calling thread is the last member.
+      pthread_mutex_init(&poolLock, NULL);
+      pthread_cond_init(&poolWake, NULL);
+      poolShutdown = 0;
+      tileRows = tileCols = numDone = numReady = 0;
+      threads = new pthread_t[numThreads-1];
+      for (int t=0; t<numThreads-1; t++)
+        if (pthread_create(&threads[t], NULL, poolThread, this) != 0) {
+          cerr << "Unable to create thread" << endl;
+          exit(-1);
+        }
+    }
     
-    return doCheckpDPA();
+    return local ? doLocalDPA() : doCheckpDPA();
   }
   
 };
@@ -273,7 +1254,8 @@ void msg(char *prog) {
   cout << "This program calculates the edit cost between two strings, and" << endl;
   cout << "displays an optimal alignment under linear gap costs.  This program uses a" << endl;
   cout << "basic DPA and check-pointing(1) to recover the alignment.  It has time complexity" << endl;
-  cout << "of O(n*n), and space complexity of O(n)" << endl;
+  cout << "of O(n*n), and space complexity of O(n).  Each pass only does the band of" << endl;
+  cout << "diagonals its cost allows, so on similar strings the time is O(n*d)" << endl;
   cout << endl;
   cout << "1:  D. R. Powell, L. Allison and T. I. Dix," << endl;
   cout << "    \"A Versatile Divide and Conquer Technique for Optimal String Alignment\"," << endl;
@@ -281,34 +1263,490 @@ void msg(char *prog) {
 
   cout << endl << endl;
 
-  cout << "Usage: " << prog << " [matchCost mismatchCost a b]" << endl;
+  cout << "Usage: " << prog << " [-t threads] [-p] [-l | -a minLen] [matchCost mismatchCost a b]" << endl;
+  cout << "   or: " << prog << " [-t threads] [-p] [-l | -a minLen] -m matrixFile [a b]" << endl;
   cout << "  where cost for gap of length k = a + b*k" << endl;
+  cout << "  -t  share each large pass among this many threads (default 1)" << endl;
+  cout << "  -p  prune the states whose cost, plus the least the rest of the pass" << endl;
+  cout << "      can cost, is more than the pass allows (needs a>=0 and b>=0)" << endl;
+  cout << "  -l  local alignment: the least cost alignment of any substrings" << endl;
+  cout << "      of A and B.  Needs matches that cost less than 0 (eg -1 1 3 1)" << endl;
+  cout << "  -a  anchored: only align between a colinear chain of exact matches," << endl;
+  cout << "      at least minLen long, that occur once in A and once in B.  Much" << endl;
+  cout << "      faster on long similar strings, but the cost may not be the least." << endl;
+  cout << "      The gaps are shared among the threads" << endl;
+  cout << "  -m  take the substitution costs from a matrix of scores, in the" << endl;
+  cout << "      NCBI format (eg BLOSUM62).  A score s is used as the cost -s" << endl;
   cout << endl << endl;
 }
 
+// alignWith() - align A and B holding costs in a Score.  Returns
+// 0 if a cost did not fit, so a wider type must be tried.  If pairs
+// is given the alignment is put there (see takeAlignment()) instead
+// of being printed.
+template <class Score, class Cost>
+int alignWith(char *A, char *B, int nThreads, int local, long long &cost,
+              char **pairs = NULL, int *nPairs = NULL)
+{
+  // The first row and column hold gaps as long as the strings.  Don't
+  // bother starting if they won't fit.
+  long long edge = Cost::a + (long long)Cost::b * MAX2(strlen(A), strlen(B));
+  if (edge >= numeric_limits<Score>::max()/2 ||
+      edge <= -(numeric_limits<Score>::max()/2))
+    return 0;
+
+  DPAlinear<Score, Cost> t(nThreads, local);
+
+  if (pairs)
+    t.noPrint();
+  cost = t.doAlign(A,B);
+  if (t.overflowed())
+    return 0;
+  if (pairs)
+    *pairs = t.takeAlignment(*nPairs);
+  return 1;
+}
+
+// alignCosts() - align A and B, in the narrowest Score that holds
+// the costs.  Most alignments fit in 16 bits.  Only go wider when
+// they don't.
+template <class Cost>
+long long alignCosts(char *A, char *B, int nThreads, int local,
+                     char **pairs = NULL, int *nPairs = NULL)
+{
+  long long cost = 0;
+
+  if (!alignWith<short, Cost>(A, B, nThreads, local, cost, pairs, nPairs) &&
+      !alignWith<int, Cost>(A, B, nThreads, local, cost, pairs, nPairs))
+    alignWith<long long, Cost>(A, B, nThreads, local, cost, pairs, nPairs);
+  return cost;
+}
+
+
+// Anchored alignment (-a minLen).  For long, mostly colinear strings,
+// exact matches that occur once in A and once in B (maximal unique
+// matches, as in MUMmer) are found and the longest colinear chain of
+// them is kept as anchors.  Only the gaps between anchors are aligned,
+// each by the check-pointing above and on a pool of threads, so the
+// time is about the sum of the squares of the gaps.  The alignment is
+// forced through the anchors, so its cost may be more than the least.
+
+// An exact match A[a..a+len) == B[b..b+len)
+struct anchorType {
+  int a, b, len;
+};
+
+// The hash of the k chars from pos in one string
+struct kmerType {
+  unsigned long long hash;
+  int pos;
+};
+
+static bool kmerLess(const kmerType &x, const kmerType &y)
+{
+  return x.hash < y.hash || (x.hash == y.hash && x.pos < y.pos);
+}
+
+static bool anchorByDiag(const anchorType &x, const anchorType &y)
+{
+  return x.a-x.b < y.a-y.b || (x.a-x.b == y.a-y.b && x.a < y.a);
+}
+
+static bool anchorByA(const anchorType &x, const anchorType &y)
+{
+  return x.a < y.a;
+}
+
+// hashKmers(s, len, k, n) - a rolling hash of every k chars of s,
+// sorted by hash.  Sets n to how many.
+static kmerType *hashKmers(const char *s, int len, int k, int &n)
+{
+  const unsigned long long base = 1000003;
+  unsigned long long top = 1, h = 0;
+  kmerType *kmers;
+
+  n = MAX2(len-k+1, 0);
+  kmers = new kmerType[n+1];
+
+  for (int i=1; i<k; i++)
+    top *= base;
+  for (int i=0; i<len; i++) {
+    if (i>=k)
+      h -= top * (unsigned char)s[i-k];
+    h = h*base + (unsigned char)s[i];
+    if (i>=k-1) {
+      kmers[i-k+1].hash = h;
+      kmers[i-k+1].pos = i-k+1;
+    }
+  }
+
+  sort(kmers, kmers+n, kmerLess);
+  return kmers;
+}
+
+// findMUMs(A, B, k, n) - the maximal unique matches of A and B at
+// least k long.  Each k chars that occur once in A and once in B
+// seed one, and are extended both ways as far as A and B match
+// (which keeps them unique).  Seeds that are inside a match already
+// found are dropped.  Sets n.
+static anchorType *findMUMs(const char *A, const char *B, int k, int &n)
+{
+  int lenA = strlen(A), lenB = strlen(B);
+  int nA, nB, i, j;
+  kmerType *ka = hashKmers(A, lenA, k, nA);
+  kmerType *kb = hashKmers(B, lenB, k, nB);
+  anchorType *mums = new anchorType[MIN2(nA, nB)+1];
+
+  n = 0;
+  for (i=j=0; i<nA && j<nB; ) {
+    if (ka[i].hash < kb[j].hash) {
+      i++;
+    } else if (ka[i].hash > kb[j].hash) {
+      j++;
+    } else {
+      int i2, j2;
+      for (i2=i+1; i2<nA && ka[i2].hash==ka[i].hash; i2++) ;
+      for (j2=j+1; j2<nB && kb[j2].hash==kb[j].hash; j2++) ;
+      if (i2==i+1 && j2==j+1 && memcmp(A+ka[i].pos, B+kb[j].pos, k)==0) {
+        mums[n].a = ka[i].pos;
+        mums[n].b = kb[j].pos;
+        mums[n].len = k;
+        n++;
+      }
+      i = i2;
+      j = j2;
+    }
+  }
+  delete[] ka;
+  delete[] kb;
+
+  // The seeds of one match are on one diagonal, in a row
+  sort(mums, mums+n, anchorByDiag);
+  int m = 0;
+  for (i=0; i<n; i++) {
+    anchorType s = mums[i];
+    if (m>0 && mums[m-1].a-mums[m-1].b == s.a-s.b &&
+        s.a < mums[m-1].a+mums[m-1].len)
+      continue;
+    while (s.a>0 && s.b>0 && A[s.a-1]==B[s.b-1]) {
+      s.a--;
+      s.b--;
+      s.len++;
+    }
+    while (s.a+s.len<lenA && s.b+s.len<lenB && A[s.a+s.len]==B[s.b+s.len])
+      s.len++;
+    mums[m++] = s;
+  }
+  n = m;
+  return mums;
+}
+
+// chainAnchors(mums, n) - the colinear chain of MUMs, each after the
+// last in both A and B, that covers the most chars.  Heaviest
+// increasing subsequence: in order along A, the best chain that ends
+// in B before each MUM starts comes from a Fenwick tree (of max) over
+// where the MUMs end in B.  A MUM goes in the tree once the ones
+// after it along A start past its end.  Puts the chain at the front
+// of mums, in order, and sets n to its length.
+static void chainAnchors(anchorType *mums, int &n)
+{
+  if (n==0)
+    return;
+
+  sort(mums, mums+n, anchorByA);
+
+  int *byEnd = new int[n];	// MUMs in order of where they end in A
+  int *ends = new int[n];	// Where each ends in B, sorted
+  long long *best = new long long[n];
+  int *prev = new int[n];
+  long long *treeBest = new long long[n+1];
+  int *treeIdx = new int[n+1];
+  int i, e, nEnds;
+
+  // Sort the ends in A with the index in the low bits
+  long long *aEnds = new long long[n];
+  for (i=0; i<n; i++) {
+    aEnds[i] = ((long long)(mums[i].a + mums[i].len) << 32) | i;
+    ends[i] = mums[i].b + mums[i].len;
+  }
+  sort(aEnds, aEnds+n);
+  for (i=0; i<n; i++)
+    byEnd[i] = (int)(aEnds[i] & 0xffffffff);
+  delete[] aEnds;
+  sort(ends, ends+n);
+  nEnds = unique(ends, ends+n) - ends;
+  for (i=0; i<=nEnds; i++) {
+    treeBest[i] = 0;
+    treeIdx[i] = -1;
+  }
+
+  for (i=e=0; i<n; i++) {
+    // Add the MUMs that end in A before this one starts
+    for (; e<n && mums[byEnd[e]].a+mums[byEnd[e]].len <= mums[i].a; e++) {
+      int y = byEnd[e];
+      int r = lower_bound(ends, ends+nEnds, mums[y].b+mums[y].len) - ends + 1;
+      for (; r<=nEnds; r += r & -r)
+        if (best[y] > treeBest[r]) {
+          treeBest[r] = best[y];
+          treeIdx[r] = y;
+        }
+    }
+
+    // The best chain ending in B at or before this one's start
+    long long q = 0;
+    int from = -1;
+    for (int r = upper_bound(ends, ends+nEnds, mums[i].b) - ends; r>0; r -= r & -r)
+      if (treeBest[r] > q) {
+        q = treeBest[r];
+        from = treeIdx[r];
+      }
+    best[i] = q + mums[i].len;
+    prev[i] = from;
+  }
+
+  int last = 0;
+  for (i=1; i<n; i++)
+    if (best[i] > best[last])
+      last = i;
+
+  int len = 0;
+  for (i=last; i>=0; i=prev[i])
+    byEnd[len++] = i;
+  anchorType *chain = new anchorType[len];
+  for (i=0; i<len; i++)
+    chain[i] = mums[byEnd[len-1-i]];
+  memcpy(mums, chain, len*sizeof(anchorType));
+  n = len;
+
+  delete[] chain;
+  delete[] byEnd;
+  delete[] ends;
+  delete[] best;
+  delete[] prev;
+  delete[] treeBest;
+  delete[] treeIdx;
+}
+
+// The stretch of A and B between two anchors, aligned on its own
+struct gapJob {
+  int a0, a1, b0, b1;		// A[a0..a1) and B[b0..b1)
+  long long cost;
+  char *pairs;			// Its alignment, see takeAlignment()
+  int nPairs;
+};
+
+// The gaps of one anchored alignment, handed out to the threads
+struct gapPool {
+  char *A, *B;
+  gapJob *jobs;
+  int nJobs, next;
+  pthread_mutex_t lock;
+};
+
+// gapThread() - align gaps from the pool until there are none left.
+// Each starts after a match (or at the start), in the diag state,
+// as doDPA() does.
+template <class Cost>
+void *gapThread(void *arg)
+{
+  gapPool *pool = (gapPool *)arg;
+
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+    int g = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (g >= pool->nJobs)
+      return NULL;
+
+    gapJob &job = pool->jobs[g];
+    char *gA = new char[job.a1-job.a0+1];
+    char *gB = new char[job.b1-job.b0+1];
+    memcpy(gA, pool->A+job.a0, job.a1-job.a0);
+    gA[job.a1-job.a0] = 0;
+    memcpy(gB, pool->B+job.b0, job.b1-job.b0);
+    gB[job.b1-job.b0] = 0;
+
+    job.cost = alignCosts<Cost>(gA, gB, 1, 0, &job.pairs, &job.nPairs);
+
+    delete[] gA;
+    delete[] gB;
+  }
+}
+
+// anchoredAlign() - align A and B through a chain of MUMs at least
+// minLen long, the gaps on nThreads threads.  Prints the alignment
+// and returns its cost.
+template <class Cost>
+long long anchoredAlign(char *A, char *B, int nThreads, int minLen)
+{
+  int lenA = strlen(A), lenB = strlen(B);
+  int nMUMs, nAnchors, g, t;
+  anchorType *anchors = findMUMs(A, B, minLen, nMUMs);
+  long long cost = 0, anchored = 0;
+  int bigA = 0, bigB = 0;
+
+  nAnchors = nMUMs;
+  chainAnchors(anchors, nAnchors);
+
+  gapPool pool;
+  pool.A = A;
+  pool.B = B;
+  pool.nJobs = nAnchors+1;
+  pool.next = 0;
+  pool.jobs = new gapJob[pool.nJobs];
+  pthread_mutex_init(&pool.lock, NULL);
+
+  for (g=0; g<pool.nJobs; g++) {
+    gapJob &job = pool.jobs[g];
+    job.a0 = (g==0 ? 0 : anchors[g-1].a + anchors[g-1].len);
+    job.b0 = (g==0 ? 0 : anchors[g-1].b + anchors[g-1].len);
+    job.a1 = (g==nAnchors ? lenA : anchors[g].a);
+    job.b1 = (g==nAnchors ? lenB : anchors[g].b);
+    if (job.a1-job.a0 > bigA) bigA = job.a1-job.a0;
+    if (job.b1-job.b0 > bigB) bigB = job.b1-job.b0;
+  }
+
+  // The calling thread is the last member of the pool
+  int nHelpers = MIN2(nThreads, pool.nJobs) - 1;
+  pthread_t *threads = new pthread_t[nHelpers+1];
+  for (t=0; t<nHelpers; t++)
+    if (pthread_create(&threads[t], NULL, gapThread<Cost>, &pool) != 0) {
+      cerr << "Unable to create thread" << endl;
+      exit(-1);
+    }
+  gapThread<Cost>(&pool);
+  for (t=0; t<nHelpers; t++)
+    pthread_join(threads[t], NULL);
+  delete[] threads;
+  pthread_mutex_destroy(&pool.lock);
+
+  for (g=0; g<nAnchors; g++)
+    anchored += anchors[g].len;
+  printf("MUMs = %d   Anchors = %d covering %lld chars   Largest gap = %d x %d\n",
+         nMUMs, nAnchors, anchored, bigA, bigB);
+
+  for (g=0; g<pool.nJobs; g++) {
+    gapJob &job = pool.jobs[g];
+    for (int i=0; i<2*job.nPairs; i+=2)
+      printf("<%c,%c> ", job.pairs[i], job.pairs[i+1]);
+    cost += job.cost;
+    delete[] job.pairs;
+
+    if (g==nAnchors)
+      break;
+    for (int i=0; i<anchors[g].len; i++) {
+      char ch = A[anchors[g].a+i];
+      printf("<%c,%c> ", ch, ch);
+      cost += (Cost::matrix ? SubMatrix::cost[SubMatrix::code[(unsigned char)ch]]
+                                              [SubMatrix::code[(unsigned char)ch]]
+                            : Cost::MatchCost);
+    }
+  }
+
+  delete[] pool.jobs;
+  delete[] anchors;
+  return cost;
+}
+
 int main(int argc, char *argv[])
 {
-  char A[MAXSTRING],B[MAXSTRING];
-  int cost;
-  DPAlinear t;
+  char *A, *B;
+  long long cost;
+  int nThreads = 1;
+  int local = 0;
+  int anchorLen = 0;
   
   msg(argv[0]);
 
-  if (argc==5) {
-    MatchCost = atoi(argv[1]);
-    MismatchCost = atoi(argv[2]);
-    a = atoi(argv[3]);
-    b = atoi(argv[4]);
+  while (argc>=2) {
+    if (argc>=3 && strcmp(argv[1],"-t")==0) {
+      nThreads = atoi(argv[2]);
+      if (nThreads < 1) nThreads = 1;
+      argc -= 2;
+      argv += 2;
+    } else if (strcmp(argv[1],"-l")==0) {
+      local = 1;
+      argc--;
+      argv++;
+    } else if (strcmp(argv[1],"-p")==0) {
+      prune = 1;
+      argc--;
+      argv++;
+    } else if (argc>=3 && strcmp(argv[1],"-a")==0) {
+      anchorLen = atoi(argv[2]);
+      if (anchorLen < 1) {
+        cerr << "Anchors must be at least 1 char long" << endl;
+        exit(1);
+      }
+      argc -= 2;
+      argv += 2;
+    } else
+      break;
   }
 
-  printf("Match=%d Mis=%d a=%d b=%d\n",MatchCost,MismatchCost,a,b);
+  if (argc>=3 && strcmp(argv[1], "-m")==0) {
+    SubMatrix::read(argv[2]);
+    MatrixCosts::MatchCost = SubMatrix::lo;
+    MatrixCosts::MismatchCost = SubMatrix::hi;
+    MatrixCosts::a = _a;
+    MatrixCosts::b = _b;
+    if (argc==5) {
+      MatrixCosts::a = atoi(argv[3]);
+      MatrixCosts::b = atoi(argv[4]);
+    }
+    printf("Matrix=%s a=%d b=%d\n",argv[2],MatrixCosts::a,MatrixCosts::b);
+  } else {
+    if (argc==5) {
+      RuntimeCosts::MatchCost = atoi(argv[1]);
+      RuntimeCosts::MismatchCost = atoi(argv[2]);
+      RuntimeCosts::a = atoi(argv[3]);
+      RuntimeCosts::b = atoi(argv[4]);
+    }
 
-  Common::readStrings(A, B);
+    printf("Match=%d Mis=%d a=%d b=%d\n",RuntimeCosts::MatchCost,
+	   RuntimeCosts::MismatchCost,RuntimeCosts::a,RuntimeCosts::b);
+  }
 
-  cost = t.doAlign(A,B);
+  // A gap that paid for itself would make local alignments grow without end
+  if (local && (SubMatrix::nCodes ? MatrixCosts::b < 0 || MatrixCosts::a+MatrixCosts::b < 0
+                                   : RuntimeCosts::b < 0 || RuntimeCosts::a+RuntimeCosts::b < 0)) {
+    cerr << "Local alignment needs b>=0 and a+b>=0" << endl;
+    exit(1);
+  }
+
+  if (local && anchorLen) {
+    cerr << "-a and -l can not be used together" << endl;
+    exit(1);
+  }
+
+  A = Common::readLine("Enter string A : ");
+  B = Common::readLine("Enter string B : ");
+
+#define TRY_COSTS(m, x, o, e) \
+  IF_COSTS(m, x, o, e, cost = (anchorLen ? \
+    anchoredAlign<Cost>(A, B, nThreads, anchorLen) : \
+    alignCosts<Cost>(A, B, nThreads, local)))
+  if (SubMatrix::nCodes) {
+    SubMatrix::check(A);
+    SubMatrix::check(B);
+    if (anchorLen)
+      cost = anchoredAlign<MatrixCosts>(A, B, nThreads, anchorLen);
+    else
+      cost = alignCosts<MatrixCosts>(A, B, nThreads, local);
+  } else {
+    COMMON_COSTS(TRY_COSTS)
+      cost = (anchorLen ? anchoredAlign<RuntimeCosts>(A, B, nThreads, anchorLen)
+                        : alignCosts<RuntimeCosts>(A, B, nThreads, local));
+  }
 
   cout << "Edit cost = " << cost << endl;
-  
+  if (prune && !local)
+    printf("Cells = %ld   Pruned = %ld   Skipped = %ld   (%.1f%% not done)\n",
+           cellCount, pruneCount, skipCount,
+           cellCount+skipCount ? 100.0*skipCount/(cellCount+skipCount) : 0.0);
+
+  delete[] A;
+  delete[] B;
 
   return 0;
 }
@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) David Powell <david@drp.id.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+// Does edit distance and alignment of 2 strings with linear insert/delete
+// costs.  Alignment is recovered Hirschberg style: at each level a forward
+// pass is run from the start to the middle row, and a backward pass (the
+// reversed problem) from the end up to the middle row.  The two passes run
+// on separate threads and the split is found by combining the two middle
+// rows over the three states.  No crossing info is carried in the cells.
+// So Time complexity O(n*n)    Space complexity O(n)
+
+
+#include <ctype.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <limits>
+
+#include "common.h"
+#include "dpa_costs.h"
+
+using namespace std;
+
+#define THREAD_MIN_CELLS 20000	// Smaller sub-problems are not worth a thread
+
+
+// Score is the integer type costs are held in, and Cost the costs, as
+// for dpa_lcheckp.  Any cost that does not fit in a Score sets
+// 'overflow', and the caller tries a wider type.
+template <class Score, class Cost>
+class DPAlinear
+{
+  private:
+
+    // enumerated type for the possible directions
+    enum direction {any=-1, horz=0, vert=1, diag=2};
+
+    typedef typename WideScore<Score>::type Wide;
+
+    // Each cell has the cost of the 3 states, one for each
+    // possible previous operation (forward pass), or for
+    // each state the cell is entered with (backward pass).
+    // A state that can not be reached costs 'big'.
+    struct dpaElem {
+      Score d[3];
+    };
+
+    // Arguments for one pass of the DPA, so it can be run
+    // on a thread of its own.
+    struct passArgs {
+      DPAlinear *t;
+      int start_i, start_j, finish_i, finish_j;
+      direction dir;
+      struct dpaElem *res;	// The row the pass finished on
+    };
+
+    char *A,*B;			// The two strings being compared
+
+    int lenA,lenB;
+
+    struct dpaElem *fwd[2];	// Two rows for the forward pass
+    struct dpaElem *bwd[2];	// Two rows for the backward pass
+    struct dpaElem *base[2];	// Rows for the 1 or 2 row base case
+
+    // Store the final alignment here - in reverse!
+    char *alignment;
+    int alignPos;
+
+    int useThreads;
+
+    Score big;			// Infinity.  Half the range of a Score
+    volatile int overflow;	// Set when a cost does not fit in a Score
+
+  private:
+
+    int subCost(int i, int j) {
+      return (A[i]==B[j]) ? Cost::MatchCost : Cost::MismatchCost;
+    }
+
+    // best3(s, add) - the least of s[x]+add[x] over the states x
+    // that can be reached (s[x] < big), or 'big' if none can.  Ties
+    // go to horz, then vert.  Sets 'overflow' if the least does not
+    // fit in a Score.  A state that can't be reached is taken as
+    // 2*big, which no sum of a Score and a cost can reach.
+    Score best3(const Score s[3], const Wide add[3])
+    {
+      const Wide none = 2*(Wide)big;
+      Wide h = (s[horz] < big ? s[horz] + add[horz] : none);
+      Wide v = (s[vert] < big ? s[vert] + add[vert] : none);
+      Wide d = (s[diag] < big ? s[diag] + add[diag] : none);
+      Wide res = (h <= v ? (h <= d ? h : d) : (v <= d ? v : d));
+
+      if (res == none)
+        return big;
+      if (res >= big || res <= -big)
+        overflow = 1;
+      return res;
+    }
+
+    // forwardPass() - standard DPA from (start_i,start_j), entered
+    // with state sDir, down to row finish_i.  The cost of each state
+    // on the last row is left in p->res.
+    void forwardPass(struct passArgs *p)
+    {
+      int i,j;
+      struct dpaElem *prev=NULL, *cur=NULL;
+      const Wide gapH[3] = {Cost::b, (Wide)Cost::a+Cost::b, (Wide)Cost::a+Cost::b};
+      const Wide gapV[3] = {(Wide)Cost::a+Cost::b, Cost::b, (Wide)Cost::a+Cost::b};
+
+      for (i=p->start_i; i<=p->finish_i; i++) {
+        cur = fwd[(i-p->start_i)%2];
+        for (j=p->start_j; j<=p->finish_j; j++) {
+          if (i==p->start_i && j==p->start_j) {
+            for (int dir=0; dir<3; dir++)
+              cur[j].d[dir] = (dir == p->dir ? 0 : big);
+            continue;
+          }
+
+          cur[j].d[horz] = (j>p->start_j) ? best3(cur[j-1].d, gapH) : big;
+          cur[j].d[vert] = (i>p->start_i) ? best3(prev[j].d, gapV) : big;
+
+          if (i>p->start_i && j>p->start_j) {
+            Wide s = subCost(i-1,j-1);
+            const Wide sub[3] = {s, s, s};
+            cur[j].d[diag] = best3(prev[j-1].d, sub);
+          } else
+            cur[j].d[diag] = big;
+        }
+        prev = cur;
+      }
+      p->res = cur;
+    }
+
+    // backwardPass() - the DPA on the reversed problem.  Works
+    // from (finish_i,finish_j), which must be left with state
+    // eDir, back up to row start_i.  d[x] of a cell is the
+    // cheapest way to finish given the cell was entered with
+    // state x, so the cost of opening a gap is known.
+    void backwardPass(struct passArgs *p)
+    {
+      int i,j;
+      struct dpaElem *prev=NULL, *cur=NULL;
+
+      for (i=p->finish_i; i>=p->start_i; i--) {
+        cur = bwd[(p->finish_i-i)%2];
+        for (j=p->finish_j; j>=p->start_j; j--) {
+          if (i==p->finish_i && j==p->finish_j) {
+            for (int dir=0; dir<3; dir++)
+              cur[j].d[dir] = (p->dir == any || dir == p->dir ? 0 : big);
+            continue;
+          }
+
+          // The next step of the path is a horz, vert or diag one
+          Score next[3];
+          next[horz] = (j<p->finish_j) ? cur[j+1].d[horz] : big;
+          next[vert] = (i<p->finish_i) ? prev[j].d[vert] : big;
+          next[diag] = (i<p->finish_i && j<p->finish_j) ? prev[j+1].d[diag] : big;
+
+          Wide s = (next[diag] < big ? subCost(i,j) : 0);
+          const Wide fromH[3] = {Cost::b, (Wide)Cost::a+Cost::b, s};
+          const Wide fromV[3] = {(Wide)Cost::a+Cost::b, Cost::b, s};
+          const Wide fromD[3] = {(Wide)Cost::a+Cost::b, (Wide)Cost::a+Cost::b, s};
+
+          cur[j].d[horz] = best3(next, fromH);
+          cur[j].d[vert] = best3(next, fromV);
+          cur[j].d[diag] = best3(next, fromD);
+        }
+        prev = cur;
+      }
+      p->res = cur;
+    }
+
+    static void *forwardThread(void *arg) {
+      struct passArgs *p = (struct passArgs *)arg;
+      p->t->forwardPass(p);
+      return NULL;
+    }
+
+    static void *backwardThread(void *arg) {
+      struct passArgs *p = (struct passArgs *)arg;
+      p->t->backwardPass(p);
+      return NULL;
+    }
+
+    // reaches(from, add, val) - true if state 'from' can be reached
+    // and a step costing add from it costs val
+    int reaches(Score from, Wide add, Score val) {
+      return from < big && (Wide)from + add == val;
+    }
+
+    // baseCase() - Only 1 or 2 rows.  Fill them in completely
+    // and trace back from (finish_i,finish_j) in state eDir.
+    long long baseCase(int start_i, int start_j, direction sDir,
+                       int finish_i, int finish_j, direction eDir)
+    {
+      int i,j;
+      const Wide gapH[3] = {Cost::b, (Wide)Cost::a+Cost::b, (Wide)Cost::a+Cost::b};
+      const Wide gapV[3] = {(Wide)Cost::a+Cost::b, Cost::b, (Wide)Cost::a+Cost::b};
+
+      for (i=start_i; i<=finish_i; i++) {
+        struct dpaElem *cur = base[i-start_i], *prev = base[0];
+        for (j=start_j; j<=finish_j; j++) {
+          if (i==start_i && j==start_j) {
+            for (int dir=0; dir<3; dir++)
+              cur[j].d[dir] = (dir == sDir ? 0 : big);
+            continue;
+          }
+          cur[j].d[horz] = (j>start_j) ? best3(cur[j-1].d, gapH) : big;
+          cur[j].d[vert] = (i>start_i) ? best3(prev[j].d, gapV) : big;
+          if (i>start_i && j>start_j) {
+            Wide s = subCost(i-1,j-1);
+            const Wide sub[3] = {s, s, s};
+            cur[j].d[diag] = best3(prev[j-1].d, sub);
+          } else
+            cur[j].d[diag] = big;
+        }
+      }
+      if (overflow)
+        return 0;
+
+      struct dpaElem *last = base[finish_i-start_i];
+      if (eDir < 0) {
+        const Wide none[3] = {0, 0, 0};
+        Score least = best3(last[finish_j].d, none);
+        eDir = (last[finish_j].d[horz] == least ? horz :
+                last[finish_j].d[vert] == least ? vert : diag);
+      }
+      Score editDist = last[finish_j].d[eDir];
+
+      i = finish_i;
+      j = finish_j;
+      direction dir = eDir;
+      while (i != start_i || j != start_j) {
+        struct dpaElem *cur = base[i-start_i];
+        Score val = cur[j].d[dir];
+        Wide c[3];
+        char c1,c2;
+
+        switch (dir) {
+        case horz:
+          c1 = '-'; c2 = B[j-1];
+          j--;
+          c[horz] = Cost::b; c[vert] = c[diag] = (Wide)Cost::a+Cost::b;
+          break;
+        case vert:
+          c1 = A[i-1]; c2 = '-';
+          i--;
+          c[vert] = Cost::b; c[horz] = c[diag] = (Wide)Cost::a+Cost::b;
+          break;
+        case diag:
+          c1 = A[i-1]; c2 = B[j-1];
+          i--; j--;
+          c[horz] = c[vert] = c[diag] = subCost(i,j);
+          break;
+        default:
+          printf("BAD logic!");  exit(911);
+        }
+
+        struct dpaElem *from = base[i-start_i];
+        if (reaches(from[j].d[horz], c[horz], val))
+          dir = horz;
+        else if (reaches(from[j].d[vert], c[vert], val))
+          dir = vert;
+        else
+          dir = diag;
+
+        alignment[alignPos++] = c1;
+        alignment[alignPos++] = c2;
+      }
+
+      return editDist;
+    }
+
+    // The Hirschberg style recursion.  Note: on first call
+    // eDir==any because the final state of the alignment is
+    // not constrained.  sDir==diag on the first call.
+    long long doDPA(
+        int start_i, int start_j,   direction sDir,
+        int finish_i, int finish_j, direction eDir)
+    {
+      if (finish_i - start_i <= 1)
+        return baseCase(start_i, start_j, sDir, finish_i, finish_j, eDir);
+
+      int midRow = (finish_i - start_i + 1)/2 + start_i;
+
+      struct passArgs f = {this, start_i, start_j, midRow, finish_j, sDir, NULL};
+      struct passArgs r = {this, midRow, start_j, finish_i, finish_j, eDir, NULL};
+
+      long cells = (long)(finish_i - start_i + 1) * (finish_j - start_j + 1);
+      pthread_t thread;
+      if (useThreads && cells >= THREAD_MIN_CELLS &&
+          pthread_create(&thread, NULL, backwardThread, &r) == 0) {
+        forwardPass(&f);
+        pthread_join(thread, NULL);
+      } else {
+        forwardPass(&f);
+        backwardPass(&r);
+      }
+      if (overflow)
+        return 0;
+
+      // Find the cheapest crossing of the middle row
+      long long editDist = 0;
+      int found = 0;
+      int split_j = start_j;
+      direction split_dir = diag;
+      for (int j=start_j; j<=finish_j; j++)
+        for (int dir=0; dir<3; dir++) {
+          if (f.res[j].d[dir] >= big || r.res[j].d[dir] >= big)
+            continue;
+          long long c = (long long)f.res[j].d[dir] + r.res[j].d[dir];
+          if (!found || c < editDist) {
+            editDist = c;
+            found = 1;
+            split_j = j;
+            split_dir = (direction)dir;
+          }
+        }
+
+      doDPA(midRow, split_j, split_dir, finish_i, finish_j, eDir);
+      doDPA(start_i, start_j, sDir, midRow, split_j, split_dir);
+
+      return editDist;
+    }
+
+    long long doHirschDPA ()
+    {
+      int i;
+      long long res;
+
+      res = doDPA(0, 0, diag, lenA, lenB, any);
+      if (overflow)
+        return 0;
+
+      for (i=alignPos-2; i>=0; i-=2)
+        printf("<%c,%c> ", alignment[i], alignment[i+1]);
+
+      return res;
+    }
+
+public:
+  DPAlinear() : alignment(NULL), useThreads(1)
+  {
+    for (int k=0; k<2; k++)
+      fwd[k] = bwd[k] = base[k] = NULL;
+    big = numeric_limits<Score>::max()/2;
+    overflow = 0;
+  }
+
+  ~DPAlinear()
+  {
+    for (int k=0; k<2; k++) {
+      delete[] fwd[k];
+      delete[] bwd[k];
+      delete[] base[k];
+    }
+    delete[] alignment;
+  }
+
+  // overflowed() - true if some cost did not fit in a Score, in
+  // which case nothing was printed and the result is meaningless.
+  int overflowed() { return overflow; }
+
+  long long doAlign(char strA[], char strB[])
+  {
+    A = strA;
+    B = strB;
+    lenA = strlen(A);
+    lenB = strlen(B);
+
+    for (int k=0; k<2; k++) {
+      fwd[k]  = new struct dpaElem[lenB+1];
+      bwd[k]  = new struct dpaElem[lenB+1];
+      base[k] = new struct dpaElem[lenB+1];
+    }
+
+    alignment = new char[(lenA+lenB)*2+2];
+    alignPos = 0;
+
+    return doHirschDPA();
+  }
+
+};
+
+void msg(char *prog) {
+  cout << "Copyright (C) David Powell <david@drp.id.au>" << endl;
+  cout << "  This program comes with ABSOLUTELY NO WARRANTY; and is provided" << endl;
+  cout << "  under the GNU Public License v2, for details see file COPYRIGHT" << endl << endl;
+
+  cout << "This program calculates the edit cost between two strings, and" << endl;
+  cout << "displays an optimal alignment under linear gap costs.  This program uses a" << endl;
+  cout << "forward and a backward DPA pass on two threads to split the problem" << endl;
+  cout << "(Hirschberg(1)) and recover the alignment.  It has time complexity" << endl;
+  cout << "of O(n*n), and space complexity of O(n)" << endl;
+  cout << endl;
+  cout << "1:  D. S. Hirschberg," << endl;
+  cout << "    \"A Linear Space Algorithm for Computing Maximal Common Subsequences\"," << endl;
+  cout << "    Communications of the ACM, 1975, 18:6, pp 341-343" << endl;
+
+  cout << endl << endl;
+
+  cout << "Usage: " << prog << " [matchCost mismatchCost a b]" << endl;
+  cout << "  where cost for gap of length k = a + b*k" << endl;
+  cout << endl << endl;
+}
+
+// alignWith() - align A and B holding costs in a Score.  Returns
+// 0 if a cost did not fit, so a wider type must be tried.
+template <class Score, class Cost>
+int alignWith(char *A, char *B, long long &cost)
+{
+  // The costs, and the gaps as long as the strings, must fit.  Don't
+  // bother starting if they won't.
+  long long lim = numeric_limits<Score>::max()/2;
+  long long edge = Cost::a + (long long)Cost::b * MAX2(strlen(A), strlen(B));
+  if (edge >= lim || edge <= -lim ||
+      (long long)Cost::a + Cost::b >= lim || (long long)Cost::a + Cost::b <= -lim ||
+      Cost::MatchCost >= lim || Cost::MatchCost <= -lim ||
+      Cost::MismatchCost >= lim || Cost::MismatchCost <= -lim)
+    return 0;
+
+  DPAlinear<Score, Cost> t;
+
+  cost = t.doAlign(A,B);
+  return !t.overflowed();
+}
+
+// alignCosts() - align A and B, in the narrowest Score that holds
+// the costs.  Most alignments fit in 16 bits.  Only go wider when
+// they don't.
+template <class Cost>
+long long alignCosts(char *A, char *B)
+{
+  long long cost = 0;
+
+  if (!alignWith<short, Cost>(A, B, cost) &&
+      !alignWith<int, Cost>(A, B, cost))
+    alignWith<long long, Cost>(A, B, cost);
+  return cost;
+}
+
+int main(int argc, char *argv[])
+{
+  char A[MAXSTRING],B[MAXSTRING];
+  long long cost;
+
+  msg(argv[0]);
+
+  if (argc==5) {
+    RuntimeCosts::MatchCost = atoi(argv[1]);
+    RuntimeCosts::MismatchCost = atoi(argv[2]);
+    RuntimeCosts::a = atoi(argv[3]);
+    RuntimeCosts::b = atoi(argv[4]);
+  }
+
+  printf("Match=%d Mis=%d a=%d b=%d\n",RuntimeCosts::MatchCost,
+         RuntimeCosts::MismatchCost,RuntimeCosts::a,RuntimeCosts::b);
+
+  Common::readStrings(A, B);
+
+#define TRY_COSTS(m, x, o, e) IF_COSTS(m, x, o, e, cost = alignCosts<Cost>(A, B))
+  COMMON_COSTS(TRY_COSTS)
+    cost = alignCosts<RuntimeCosts>(A, B);
+
+  cout << "Edit cost = " << cost << endl;
+
+
+  return 0;
+}
@@ -24,34 +24,60 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "common.h"
+#include "submatrix.h"
+#include "dpa_costs.h"
 
 using namespace std;
 
+#define BLOCK_SIZE 32		// Recursion stops at blocks this size
+#define LANES      8		// 16 bit scores in an SSE2 register
 
-#define _a 3			// insert(delete) cost = w(k) = a+b*k
-#define _b 1			// Where k is number or inserts(deletes)
-#define _MatchCost    0		// Cost of a match
-#define _MismatchCost 1		// Cost of a mismatch
 
-int a = _a;
-int b = _b;
-int MatchCost = _MatchCost;
-int MismatchCost = _MismatchCost;
+#ifdef __SSE2__
+// The argmin of 3 vectors, coded as in DPAlinear::fillBlock().  Ties
+// go to h, then v.
+static inline __m128i minDir3(__m128i h, __m128i v, __m128i d)
+{
+  __m128i isH = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(h, v),
+                                              _mm_cmpgt_epi16(h, d)),
+                                 _mm_set1_epi32(-1));
+  __m128i isV = _mm_andnot_si128(_mm_cmpgt_epi16(v, d),
+                                 _mm_cmplt_epi16(v, h));
+  // The masks are -1, so this is 0 for h, 1 for v, and 2 for d
+  return _mm_add_epi16(_mm_set1_epi16(2),
+                       _mm_add_epi16(_mm_add_epi16(isH, isH), isV));
+}
 
+// Move each lane up one, and put 'first' in lane 0
+static inline __m128i shiftIn(__m128i v, short first)
+{
+  return _mm_insert_epi16(_mm_slli_si128(v, 2), first, 0);
+}
+#endif
+
+// Score is the integer type costs are held in.  Any cost that does
+// not fit sets 'overflow', and the caller tries a wider type.  Cost
+// is FixedCosts<> or RuntimeCosts.
+template <class Score, class Cost>
 class DPAlinear
 {
 private:
 
+  typedef typename WideScore<Score>::type Wide;
   
   struct dpaElem {
-    int horz;
-    int vert;
-    int diag;
+    Score horz;
+    Score vert;
+    Score diag;
   };
 
-  typedef struct dpaElem* dpaElemPtr;
+  typedef unsigned char* dirPtr;
 
   enum direction {horz, vert, diag};
   
@@ -59,16 +85,67 @@ private:
 
   int lenA,lenB;
   
-  struct dpaElem **data;	// Where the 2D DPA array will reside.
-				// Uses an array of pointers to each row.
+  unsigned char **dirs;		// For each cell, the state each of horz,
+				// vert and diag was reached from, 2 bits
+				// each.  Uses an array of pointers to each row.
+				// Use dirAt(), the rows may be striped.
+
+  int segLen;			// Vectors per row when striped, else 0
+
+  struct dpaElem *hrow;		// Scores of the last row filled, per column
+  struct dpaElem *vcol;		// Scores of the last column filled, per row
+
+  int *rowProfile;		// MatrixCosts only.  The query profile: for
+				// each residue code, the diag cost against
+				// each column of B.  Row code is at
+				// rowProfile[code*(lenB+1)], see profRow().
+
+  Score big;			// Infinity.  Half the range of a Score
+  int overflow;			// Set when a cost does not fit in a Score
 
 private:
 
+  // dirAt(i,j) - the directions of cell (i,j).  When striped,
+  // column j is in lane (j-1)/segLen of vector (j-1)%segLen.
+  unsigned char &dirAt(int i, int j)
+  {
+    if (segLen==0 || j==0)
+      return dirs[i][j];
+    return dirs[i][1 + ((j-1)%segLen)*LANES + (j-1)/segLen];
+  }
+
+  // stripes() - vectors per row, if fillStriped() can handle a
+  // Score.  Only 16 bit Scores can, the (Score *) argument picks the
+  // short version, see below.
+  int stripes() { return stripes((Score *)0); }
+  void fillStriped() { fillStriped((Score *)0); }
+  int stripes(void *) { return 0; }
+  void fillStriped(void *) {}
+
+  // profRow(c) - the profile row for the char c of A.  Indexed by
+  // column of B, from 1.
+  const int *profRow(char c)
+  {
+    return &rowProfile[SubMatrix::code[(unsigned char)c] * (long)(lenB+1)];
+  }
+
+  // makeProfile() - fill in rowProfile[], once for the whole alignment
+  void makeProfile()
+  {
+    rowProfile = new int[SubMatrix::nCodes * (long)(lenB+1)];
+    for (int c=0; c<SubMatrix::nCodes; c++) {
+      int *row = &rowProfile[c * (long)(lenB+1)];
+      row[0] = 0;
+      for (int j=1; j<=lenB; j++)
+	row[j] = SubMatrix::cost[c][SubMatrix::code[(unsigned char)B[j-1]]];
+    }
+  }
+
   direction minDirection(struct dpaElem d, int i, int j)
   {
     direction res;
-    if (i==0) d.vert = BIG_VAL;
-    if (j==0) d.horz = BIG_VAL;
+    if (i==0) d.vert = big;
+    if (j==0) d.horz = big;
     
     if (d.horz <= d.vert)
       if (d.horz <= d.diag)
@@ -90,40 +167,31 @@ private:
     
     i = lenA;
     j = lenB;
-    direction dir = minDirection(data[i][j],i,j);
+    direction dir = minDirection(lenB==0 ? vcol[lenA] : hrow[lenB],i,j);
 
     while (i!=0 || j!=0) {
       char ch1, ch2;
-      struct dpaElem d;
+      direction from = (direction)((dirAt(i,j) >> (2*dir)) & 3);
       
       ch1 = ch2 = '-';
       switch (dir) {
       case horz:
 	ch2 = B[j-1];
 	j--;
-	d.diag = data[i][j].diag + a + b;
-	d.horz = data[i][j].horz +     b;
-	d.vert = data[i][j].vert + a + b;
 	break;
       case vert:
 	ch1 = A[i-1];
 	i--;
-	d.diag = data[i][j].diag + a + b;
-	d.horz = data[i][j].horz + a + b;
-	d.vert = data[i][j].vert +     b;
 	break;
       case diag:
 	ch1 = A[i-1];
 	ch2 = B[j-1];
 	i--;
 	j--;
-	d.diag = data[i][j].diag;
-	d.horz = data[i][j].horz;
-	d.vert = data[i][j].vert;
 	break;
       }
 
-      dir = minDirection(d,1,1);
+      dir = from;
       alignment[pos++] = ch1;
       alignment[pos++] = ch2;
     }
@@ -132,71 +200,348 @@ private:
       printf("<%c,%c> ",alignment[i-1],alignment[i]);
   }
   
-  int doDPA()
+  // minCost() - smallest of h, v and d, and the direction it came from.
+  // Ties are broken in the same order as minDirection()
+  // Sets 'overflow' if that does not fit in a Score.
+  Score minCost(Wide h, Wide v, Wide d, int &from)
+  {
+    Wide res;
+    if (h <= v) {
+      if (h <= d) { from = horz; res = h; }
+      else        { from = diag; res = d; }
+    } else if (v <= d) { from = vert; res = v; }
+    else               { from = diag; res = d; }
+
+    if (res >= big || res <= -big)
+      overflow = 1;
+    return res;
+  }
+
+  // fillBlock() - fill in rows i0..i1, columns j0..j1.  Scores are read
+  // from and written back to hrow[] and vcol[], 'corner' is cell
+  // (i0-1,j0-1).  Only the directions are kept for every cell.
+  void fillBlock(int i0, int i1, int j0, int j1, struct dpaElem corner)
+  {
+    int i,j;
+
+    for (i=i0; i<=i1; i++) {
+      struct dpaElem left = vcol[i], upLeft = corner;
+      const int *pRow = (Cost::matrix ? profRow(A[i-1]) : NULL);
+      corner = left;
+
+      for (j=j0; j<=j1; j++) {
+	struct dpaElem up = hrow[j], cur;
+	int fromH, fromV, fromD;
+
+	cur.horz = minCost(
+	  (Wide)left.horz + Cost::b,
+	  (Wide)left.vert + Cost::a + Cost::b,
+	  (Wide)left.diag + Cost::a + Cost::b, fromH);
+
+	cur.vert = minCost(
+	  (Wide)up.horz + Cost::a + Cost::b,
+	  (Wide)up.vert + Cost::b,
+	  (Wide)up.diag + Cost::a + Cost::b, fromV);
+	
+	int diagCost = Cost::matrix ? pRow[j] :
+	  (A[i-1]==B[j-1]) ? Cost::MatchCost : Cost::MismatchCost;
+	
+	cur.diag = minCost(
+	  (Wide)upLeft.horz + diagCost,
+	  (Wide)upLeft.vert + diagCost,
+	  (Wide)upLeft.diag + diagCost, fromD);
+	
+	dirs[i][j] = fromH | (fromV<<2) | (fromD<<4);
+//        printf("H=%d V=%d D=%d    ",cur.horz,cur.vert,cur.diag);
+
+	hrow[j] = left = cur;
+	upLeft = up;
+      }
+      vcol[i] = left;
+    }
+  }
+
+  // fillMatrix() - cache-oblivious traversal of the matrix.  The
+  // longer side is halved until the block is small, so at every
+  // scale the rows being worked on fit in the cache.  'corner' is
+  // cell (i0-1,j0-1), which hrow[] and vcol[] may no longer hold.
+  void fillMatrix(int i0, int i1, int j0, int j1, struct dpaElem corner)
+  {
+    if (i1-i0 < BLOCK_SIZE && j1-j0 < BLOCK_SIZE) {
+      fillBlock(i0, i1, j0, j1, corner);
+    } else if (i1-i0 >= j1-j0) {
+      int mid = (i0+i1)/2;
+      struct dpaElem c = vcol[mid];
+      fillMatrix(i0, mid, j0, j1, corner);
+      fillMatrix(mid+1, i1, j0, j1, c);
+    } else {
+      int mid = (j0+j1)/2;
+      struct dpaElem c = hrow[mid];
+      fillMatrix(i0, i1, j0, mid, corner);
+      fillMatrix(i0, i1, mid+1, j1, c);
+    }
+  }
+
+  long long doDPA()
   {
     int i,j;
 
     for (i=1;i<=lenA;i++) {
-      data[i][0].horz = BIG_VAL;
-      data[i][0].vert = a+b*i;
-      data[i][0].diag = BIG_VAL;
+      vcol[i].horz = big;
+      vcol[i].vert = (Score)Cost::a + (Score)Cost::b*i;
+      vcol[i].diag = big;
+      dirAt(i,0) = (i==1 ? diag : vert) << 2;
     }
     for (j=1;j<=lenB;j++) {
-      data[0][j].horz = a+b*j;
-      data[0][j].vert = BIG_VAL;
-      data[0][j].diag = BIG_VAL;
+      hrow[j].horz = (Score)Cost::a + (Score)Cost::b*j;
+      hrow[j].vert = big;
+      hrow[j].diag = big;
+      dirAt(0,j) = (j==1 ? diag : horz);
+    }
+    hrow[0].diag = 0;
+    hrow[0].vert = big;
+    hrow[0].horz = big;
+    vcol[0] = hrow[0];
+    dirAt(0,0) = 0;
+
+    if (lenA>0 && lenB>0) {
+      if (segLen)
+        fillStriped();
+      else
+        fillMatrix(1, lenA, 1, lenB, hrow[0]);
+    }
+
+    if (overflow)
+      return 0;
+
+    dispAlign();
+
+    struct dpaElem final = (lenB==0 ? vcol[lenA] : hrow[lenB]);
+    return MIN3(final.horz, final.vert, final.diag);
+  }
+
+#ifdef __SSE2__
+  // Striped SSE2 version of fillMatrix() for 16 bit scores (M. Farrar,
+  // "Striped Smith-Waterman speeds database searches six times over
+  // other SIMD implementations", Bioinformatics, 2007, 23:2, pp 156-161).
+  // Column j of a row is in lane (j-1)/segLen of vector (j-1)%segLen, so
+  // vert and diag for a whole vector only need the previous row.  horz
+  // runs along the row, it is done a vector at a time ignoring the carry
+  // from one lane to the next, then the lazy-F loop fixes up the lanes
+  // that the carry improves.  Only the last row's scores are kept, the
+  // directions are worked out once the row is final, with the same ties
+  // as fillBlock().
+
+  int stripes(short *)
+  {
+    return (lenB + LANES-1)/LANES;
+  }
+
+  void fillStriped(short *)
+  {
+    int i, k, l;
+    short tmp[LANES];
+
+    // The profile and the sums below are 16 bit, so costs must fit too
+    if ((Wide)Cost::a+Cost::b >= big || (Wide)Cost::a+Cost::b <= -big ||
+        Cost::b >= big || Cost::b <= -big ||
+        Cost::MatchCost >= big || Cost::MatchCost <= -big ||
+        Cost::MismatchCost >= big || Cost::MismatchCost <= -big) {
+      overflow = 1;
+      return;
+    }
+
+    // Query profile: the diag cost of each column of B, for each char
+    // of A (each residue code with a matrix), striped like the rows
+    __m128i *profile[256];
+    for (k=0; k<256; k++)
+      profile[k] = NULL;
+    for (i=0; i<lenA; i++) {
+      unsigned char c = (Cost::matrix ? SubMatrix::code[(unsigned char)A[i]] : A[i]);
+      if (profile[c]) continue;
+      profile[c] = new __m128i[segLen];
+      for (k=0; k<segLen; k++) {
+        for (l=0; l<LANES; l++) {
+          int j = l*segLen + k + 1;
+          if (j > lenB)
+            tmp[l] = Cost::MismatchCost;
+          else if (Cost::matrix)
+            tmp[l] = profRow(A[i])[j];
+          else
+            tmp[l] = (B[j-1]==A[i]) ? Cost::MatchCost : Cost::MismatchCost;
+        }
+        profile[c][k] = _mm_loadu_si128((__m128i *)tmp);
+      }
+    }
+
+    // Lanes past the end of B are padding, they never reach a real column
+    __m128i *valid = new __m128i[segLen];
+    for (k=0; k<segLen; k++) {
+      for (l=0; l<LANES; l++)
+        tmp[l] = (l*segLen + k + 1 <= lenB) ? -1 : 0;
+      valid[k] = _mm_loadu_si128((__m128i *)tmp);
     }
-    data[0][0].diag = 0;
-    data[0][0].vert = BIG_VAL;
-    data[0][0].horz = BIG_VAL;
+
+    __m128i *rows = new __m128i[6*segLen];
+    __m128i *pH = rows, *pV = pH+segLen, *pD = pV+segLen;	// Previous row
+    __m128i *cH = pD+segLen, *cV = cH+segLen, *cD = cV+segLen;	// This row
+
+    // Row 0
+    for (k=0; k<segLen; k++) {
+      for (l=0; l<LANES; l++) {
+        int j = l*segLen + k + 1;
+        tmp[l] = (j<=lenB ? hrow[j].horz : big);
+      }
+      pH[k] = _mm_loadu_si128((__m128i *)tmp);
+      pV[k] = pD[k] = _mm_set1_epi16(big);
+    }
+    struct dpaElem p0 = hrow[0];		// Column 0 of the previous row
+
+    const __m128i vB = _mm_set1_epi16(Cost::b);
+    const __m128i vAB = _mm_set1_epi16(Cost::a+Cost::b);
+    const __m128i vBig = _mm_set1_epi16(big-1), vNegBig = _mm_set1_epi16(-big+1);
+    __m128i ov = _mm_setzero_si128();
 
     for (i=1; i<=lenA; i++) {
-//      printf("\n%d  ",i);
-      for (j=1; j<=lenB; j++) {
-
-	data[i][j].horz = MIN3(
-	  data[i][j-1].horz + b,
-	  data[i][j-1].vert + a + b,
-	  data[i][j-1].diag + a + b);
-
-	data[i][j].vert = MIN3(
-	  data[i-1][j].horz + a + b,
-	  data[i-1][j].vert + b,
-	  data[i-1][j].diag + a + b);
-	
-	int diagCost = (A[i-1]==B[j-1]) ? MatchCost : MismatchCost;
-	
-	data[i][j].diag = MIN3(
-	  data[i-1][j-1].horz + diagCost,
-	  data[i-1][j-1].vert + diagCost,
-	  data[i-1][j-1].diag + diagCost);
-	
-//        printf("H=%d V=%d D=%d    ",data[i][j].horz,data[i][j].vert,data[i][j].diag);
+      __m128i *prof = profile[Cost::matrix ? SubMatrix::code[(unsigned char)A[i-1]]
+                                            : (unsigned char)A[i-1]];
+      struct dpaElem c0 = vcol[i];	// Column 0 of this row
+
+      // vert and diag, which only need the previous row
+      __m128i ulH = shiftIn(pH[segLen-1], p0.horz);
+      __m128i ulV = shiftIn(pV[segLen-1], p0.vert);
+      __m128i ulD = shiftIn(pD[segLen-1], p0.diag);
+      for (k=0; k<segLen; k++) {
+        cV[k] = _mm_min_epi16(_mm_min_epi16(_mm_adds_epi16(pH[k], vAB),
+                                            _mm_adds_epi16(pV[k], vB)),
+                              _mm_adds_epi16(pD[k], vAB));
+        cD[k] = _mm_adds_epi16(_mm_min_epi16(_mm_min_epi16(ulH, ulV), ulD),
+                               prof[k]);
+        ulH = pH[k]; ulV = pV[k]; ulD = pD[k];
+      }
+
+      // horz, first ignoring the carry between lanes
+      __m128i lH = shiftIn(_mm_set1_epi16(big), c0.horz);
+      __m128i lV = shiftIn(cV[segLen-1], c0.vert);
+      __m128i lD = shiftIn(cD[segLen-1], c0.diag);
+      for (k=0; k<segLen; k++) {
+        cH[k] = _mm_min_epi16(_mm_adds_epi16(lH, vB),
+                              _mm_adds_epi16(_mm_min_epi16(lV, lD), vAB));
+        lH = cH[k]; lV = cV[k]; lD = cD[k];
+      }
+
+      // Lazy-F: carry horz from the last vector into the next lane up,
+      // until it no longer improves anything
+      __m128i f = _mm_adds_epi16(shiftIn(cH[segLen-1], big), vB);
+      for (l=0; l<LANES; l++) {
+        for (k=0; k<segLen; k++) {
+          if (!_mm_movemask_epi8(_mm_cmplt_epi16(f, cH[k])))
+            goto horzDone;
+          cH[k] = _mm_min_epi16(cH[k], f);
+          f = _mm_adds_epi16(cH[k], vB);
+        }
+        f = shiftIn(f, big);
+      }
+    horzDone:
+
+      // Directions, now all three states are final
+      lH = shiftIn(cH[segLen-1], c0.horz);
+      lV = shiftIn(cV[segLen-1], c0.vert);
+      lD = shiftIn(cD[segLen-1], c0.diag);
+      ulH = shiftIn(pH[segLen-1], p0.horz);
+      ulV = shiftIn(pV[segLen-1], p0.vert);
+      ulD = shiftIn(pD[segLen-1], p0.diag);
+      for (k=0; k<segLen; k++) {
+        __m128i fromH = minDir3(_mm_adds_epi16(lH, vB),
+                                _mm_adds_epi16(lV, vAB),
+                                _mm_adds_epi16(lD, vAB));
+        __m128i fromV = minDir3(_mm_adds_epi16(pH[k], vAB),
+                                _mm_adds_epi16(pV[k], vB),
+                                _mm_adds_epi16(pD[k], vAB));
+        __m128i fromD = minDir3(ulH, ulV, ulD);
+        __m128i code = _mm_or_si128(fromH,
+                                    _mm_or_si128(_mm_slli_epi16(fromV, 2),
+                                                 _mm_slli_epi16(fromD, 4)));
+        _mm_storel_epi64((__m128i *)&dirs[i][1 + k*LANES],
+                         _mm_packus_epi16(code, code));
+
+        __m128i out = _mm_or_si128(
+          _mm_or_si128(_mm_cmpgt_epi16(cH[k], vBig), _mm_cmplt_epi16(cH[k], vNegBig)),
+          _mm_or_si128(
+            _mm_or_si128(_mm_cmpgt_epi16(cV[k], vBig), _mm_cmplt_epi16(cV[k], vNegBig)),
+            _mm_or_si128(_mm_cmpgt_epi16(cD[k], vBig), _mm_cmplt_epi16(cD[k], vNegBig))));
+        ov = _mm_or_si128(ov, _mm_and_si128(out, valid[k]));
+
+        lH = cH[k]; lV = cV[k]; lD = cD[k];
+        ulH = pH[k]; ulV = pV[k]; ulD = pD[k];
       }
+
+      __m128i *t;
+      t = pH; pH = cH; cH = t;
+      t = pV; pV = cV; cV = t;
+      t = pD; pD = cD; cD = t;
+      p0 = c0;
     }
 
-    dispAlign();
+    if (_mm_movemask_epi8(ov))
+      overflow = 1;
+
+    // Leave the last row's final cell where doDPA() expects it
+    k = (lenB-1)%segLen;
+    l = (lenB-1)/segLen;
+    _mm_storeu_si128((__m128i *)tmp, pH[k]); hrow[lenB].horz = tmp[l];
+    _mm_storeu_si128((__m128i *)tmp, pV[k]); hrow[lenB].vert = tmp[l];
+    _mm_storeu_si128((__m128i *)tmp, pD[k]); hrow[lenB].diag = tmp[l];
 
-    return MIN3(data[lenA][lenB].horz,
-		data[lenA][lenB].vert,
-		data[lenA][lenB].diag);
+    for (k=0; k<256; k++)
+      delete[] profile[k];
+    delete[] valid;
+    delete[] rows;
   }
-  
+#endif
+
 public:
-  int doAlign(char strA[], char strB[])
+  DPAlinear() : dirs(NULL), hrow(NULL), vcol(NULL), rowProfile(NULL)
+  {
+    big = numeric_limits<Score>::max()/2;
+    overflow = 0;
+  }
+
+  ~DPAlinear()
   {
-    struct dpaElem *tmp;
-    int i;
+    if (dirs) delete[] dirs[0];
+    delete[] dirs;
+    delete[] hrow;
+    delete[] vcol;
+    delete[] rowProfile;
+  }
+
+  // overflowed() - true if some cost did not fit in a Score, in
+  // which case nothing was printed and the result is meaningless.
+  int overflowed() { return overflow; }
+
+  long long doAlign(char strA[], char strB[])
+  {
+    unsigned char *tmp;
+    int i, rowLen;
     
     A = strA;
     B = strB;
     lenA = strlen(A);
     lenB = strlen(B);
 
-    data = new dpaElemPtr[lenA+1];
-    tmp = new struct dpaElem[(lenA+1) * (lenB+1)];
+    segLen = stripes();
+    rowLen = (segLen ? 1 + segLen*LANES : lenB+1);
+
+    hrow = new struct dpaElem[lenB+1];
+    vcol = new struct dpaElem[lenA+1];
+    dirs = new dirPtr[lenA+1];
+    tmp = new unsigned char[(lenA+1) * (long)rowLen];
     for (i=0;i<=lenA;i++)
-      data[i] = &tmp[i * (lenB+1)];
+      dirs[i] = &tmp[i * (long)rowLen];
+
+    if (Cost::matrix)
+      makeProfile();
 
     return doDPA(); 
   }
@@ -210,33 +555,90 @@ void msg(char *prog) {
 
   cout << "This program calculates the edit cost between two strings, and" << endl;
   cout << "displays an optimal alignment under linear gap costs.  This program uses a" << endl;
-  cout << "basic DPA and has time and space complexity of O(n*n)" << endl;
+  cout << "basic DPA and has time and space complexity of O(n*n), keeping only" << endl;
+  cout << "one byte of traceback per cell" << endl;
   cout << endl;
   cout << "Usage: " << prog << " [matchCost mismatchCost a b]" << endl;
+  cout << "   or: " << prog << " -m matrixFile [a b]" << endl;
   cout << "  where cost for gap of length k = a + b*k" << endl;
+  cout << "  -m takes the substitution costs from a matrix of scores, in the" << endl;
+  cout << "     NCBI format (eg BLOSUM62).  A score s is used as the cost -s" << endl;
   cout << endl << endl;
 }
 
+// alignWith() - align A and B holding costs in a Score.  Returns
+// 0 if a cost did not fit, so a wider type must be tried.
+template <class Score, class Cost>
+int alignWith(char *A, char *B, long long &cost)
+{
+  // The first row and column hold gaps as long as the strings.  Don't
+  // bother starting if they won't fit.
+  long long edge = Cost::a + (long long)Cost::b * MAX2(strlen(A), strlen(B));
+  if (edge >= numeric_limits<Score>::max()/2 ||
+      edge <= -(numeric_limits<Score>::max()/2))
+    return 0;
+
+  DPAlinear<Score, Cost> t;
+
+  cost = t.doAlign(A,B);
+  return !t.overflowed();
+}
+
+// alignCosts() - align A and B, in the narrowest Score that holds
+// the costs.  Most alignments fit in 16 bits.  Only go wider when
+// they don't.
+template <class Cost>
+long long alignCosts(char *A, char *B)
+{
+  long long cost = 0;
+
+  if (!alignWith<short, Cost>(A, B, cost) &&
+      !alignWith<int, Cost>(A, B, cost))
+    alignWith<long long, Cost>(A, B, cost);
+  return cost;
+}
+
 int main(int argc, char *argv[])
 {
   char A[MAXSTRING],B[MAXSTRING];
-  int cost;
-  DPAlinear t;
+  long long cost;
 
   msg(argv[0]);
-  
-  if (argc==5) {
-    MatchCost = atoi(argv[1]);
-    MismatchCost = atoi(argv[2]);
-    a = atoi(argv[3]);
-    b = atoi(argv[4]);
-  }
 
-  printf("Match=%d Mis=%d a=%d b=%d\n",MatchCost,MismatchCost,a,b);
+  if (argc>=3 && strcmp(argv[1], "-m")==0) {
+    SubMatrix::read(argv[2]);
+    MatrixCosts::MatchCost = SubMatrix::lo;
+    MatrixCosts::MismatchCost = SubMatrix::hi;
+    MatrixCosts::a = _a;
+    MatrixCosts::b = _b;
+    if (argc==5) {
+      MatrixCosts::a = atoi(argv[3]);
+      MatrixCosts::b = atoi(argv[4]);
+    }
+    printf("Matrix=%s a=%d b=%d\n",argv[2],MatrixCosts::a,MatrixCosts::b);
+  } else {
+    if (argc==5) {
+      RuntimeCosts::MatchCost = atoi(argv[1]);
+      RuntimeCosts::MismatchCost = atoi(argv[2]);
+      RuntimeCosts::a = atoi(argv[3]);
+      RuntimeCosts::b = atoi(argv[4]);
+    }
+
+    printf("Match=%d Mis=%d a=%d b=%d\n",RuntimeCosts::MatchCost,
+	   RuntimeCosts::MismatchCost,RuntimeCosts::a,RuntimeCosts::b);
+  }
 
   Common::readStrings(A, B);
 
-  cost = t.doAlign(A,B);
+#define TRY_COSTS(m, x, o, e) IF_COSTS(m, x, o, e, cost = alignCosts<Cost>(A, B))
+  if (SubMatrix::nCodes) {
+    SubMatrix::check(A);
+    SubMatrix::check(B);
+    cost = alignCosts<MatrixCosts>(A, B);
+  } else {
+    COMMON_COSTS(TRY_COSTS)
+      cost = alignCosts<RuntimeCosts>(A, B);
+  }
 
   cout << "Edit cost = " << cost << endl;
   
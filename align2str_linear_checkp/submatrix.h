@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) David Powell <david@drp.id.au>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+// A substitution matrix, for the dpa_ programs.  Read from a file in
+// the NCBI format (as BLOSUM62 and PAM250 are distributed):
+//
+//   # Comment lines start with a #
+//      A  R  N  D ...
+//   A  4 -1 -2 -2 ...
+//   R -1  5  0 -2 ...
+//
+// The entries are scores (bigger is better), the DPA minimises cost,
+// so each is used as the cost -score.  Residues are encoded as
+// 0..nCodes-1 in the order of the header line.
+
+#ifndef __SUBMATRIX_H__
+#define __SUBMATRIX_H__
+
+#include <ctype.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+using namespace std;
+
+#define MAXCODES 32		// Most residues a matrix may have
+#define NOCODE   255		// code[] of a char not in the matrix
+
+class SubMatrix {
+
+public:
+
+  static int nCodes;			// Residues in the matrix, 0 for none
+  static unsigned char code[256];	// Code of each char
+  static int cost[MAXCODES][MAXCODES];	// Cost of aligning 2 codes
+  static int lo, hi;			// Smallest and largest cost
+
+  static void read(const char *fname) {
+    FILE *f = fopen(fname, "r");
+    char line[1024], *tok;
+    int i, j, row = 0;
+
+    if (!f) {
+      cerr << "Unable to open matrix file " << fname << endl;
+      exit(1);
+    }
+
+    memset(code, NOCODE, sizeof(code));
+    nCodes = 0;
+    while (fgets(line, sizeof(line), f)) {
+      if (line[0]=='#' || !(tok = strtok(line, " \t\r\n")))
+	continue;
+
+      if (nCodes==0) {		// The header line
+	for (; tok; tok = strtok(NULL, " \t\r\n")) {
+	  if (strlen(tok)!=1 || nCodes==MAXCODES) {
+	    cerr << "Bad header line in matrix file " << fname << endl;
+	    exit(1);
+	  }
+	  code[(unsigned char)tok[0]] = nCodes++;
+	}
+	continue;
+      }
+
+      if (strlen(tok)!=1 || code[(unsigned char)tok[0]]==NOCODE ||
+	  row==nCodes) {
+	cerr << "Bad row '" << tok << "' in matrix file " << fname << endl;
+	exit(1);
+      }
+      i = code[(unsigned char)tok[0]];
+      for (j=0; j<nCodes; j++) {
+	if (!(tok = strtok(NULL, " \t\r\n"))) {
+	  cerr << "Short row in matrix file " << fname << endl;
+	  exit(1);
+	}
+	cost[i][j] = -atoi(tok);
+      }
+      row++;
+    }
+    fclose(f);
+
+    if (nCodes==0 || row!=nCodes) {
+      cerr << "Matrix file " << fname << " needs a row for each residue" << endl;
+      exit(1);
+    }
+
+    // Lower case letters are the same residue, unless the matrix says not
+    for (i=0; i<256; i++)
+      if (isupper(i) && code[i]!=NOCODE && code[tolower(i)]==NOCODE)
+	code[tolower(i)] = code[i];
+
+    lo = hi = cost[0][0];
+    for (i=0; i<nCodes; i++)
+      for (j=0; j<nCodes; j++) {
+	lo = MIN2(lo, cost[i][j]);
+	hi = MAX2(hi, cost[i][j]);
+      }
+  }
+
+  // check(s) - every char of s must be in the matrix
+  static void check(const char *s) {
+    for (; *s; s++)
+      if (code[(unsigned char)*s]==NOCODE) {
+	cerr << "Character '" << *s << "' is not in the matrix" << endl;
+	exit(1);
+      }
+  }
+
+};
+
+int SubMatrix::nCodes = 0;
+unsigned char SubMatrix::code[256];
+int SubMatrix::cost[MAXCODES][MAXCODES];
+int SubMatrix::lo, SubMatrix::hi;
+
+#endif
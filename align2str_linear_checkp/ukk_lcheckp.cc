@@ -30,14 +30,18 @@
 #include <stdlib.h>
 #include <malloc.h>
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "ukk_linear.h"
 
 using namespace std;
 
-#undef MODSIZE
-#define MODSIZE      (MAX2((a+b)+1, MismatchCost)+1)
+				// Size of window on ukkonen matrix.
+				// For a description of why this size is
+				// necessary read window_size.note
+#define MODSIZE      (MAX2((Cost::a+Cost::b)+1, Cost::MismatchCost)+1)
 
 
 #define MAXDIR3(x,y,z) ((x)>=(y) ? \
@@ -45,15 +49,30 @@ using namespace std;
 			((y)>=(z) ? horz : vert))
 
 
-#define CHECKPSIZE   (MAX2((a+b), MismatchCost)+1)
+#define CHECKPSIZE   (MAX2((Cost::a+Cost::b), Cost::MismatchCost)+1)
+				// Costs of check-point data kept.  One more
+				// than the window, else a cell's data can be
+				// overwritten (by the cell CHECKPSIZE costs on)
+				// while a step from it is still to be worked out.
+#define CHECKPRING   (CHECKPSIZE+1)
 #define NUMDIRS 3		// Three directions horz,vert,diag.
 
+#define VAL_BITS   16		// Bits of a cell for its value, and
+#define EPOCH_BITS 16		// for the doUkk() call it is from
+#if MAXSTRING+2 >= (1<<VAL_BITS)
+#error "VAL_BITS too small for MAXSTRING"
+#endif
+
+template <class Cost>
 class UkkonenCheckp
 {
   struct ukkElem {
-    int val;		     // Contents of this cell
+    unsigned val   : VAL_BITS;   // Contents of this cell, see cellVal()
+    unsigned epoch : EPOCH_BITS; // epoch of the doUkk() call that
+				 // calculated this cell, or 0
+#ifdef DEBUG
     int cost;		     // Cost of this cell (used for debugging)
-    int done;		     // Flag for whether this cell has been calculated
+#endif
   };
 
   enum direction {nodir=-1, diag, horz, vert};
@@ -66,35 +85,119 @@ class UkkonenCheckp
 
     direction fromDir;
     int fromCost, fromDiag;    
+
+    int epoch;			// doUkk() call this is for
   };
   
   
   char *A, *B;			// Two strings to be aligned
   int lenA,lenB;		// Length of the two strings
-  struct ukkElem (*data)[MODSIZE][NUMDIRS];
+  struct ukkElem *data;		// [cost%MODSIZE][dir][diag], use at()
 
-  struct checkpElem (*checkp)[CHECKPSIZE][NUMDIRS];
+  struct checkpElem *checkp;	// [cost%CHECKPRING][dir][diag], use cpAt()
   int checkpCost;
   
   int offset;			// Offset into data[] because -ve indices
 				// needed.
   int arraySize;		// Number of rows allocated for each array
 
+  int furthest;			// Furthest along A any cell has reached
+
+  int epoch;			// Stamp of the current doUkk() call.  Cells
+				// with an older stamp are treated as empty,
+				// so the arrays need not be cleared for
+				// each call, only when the stamp wraps.
+
 #if DEBUG
   int depth=-2;
 #endif
 
 private:
+  // Each (cost, dir) has a run of cells for all the diagonals, so
+  // the neighbouring diagonals a cell depends on are close by.
+  struct ukkElem &at(int d, int c, int dir)
+  {
+    return data[((c%MODSIZE)*NUMDIRS + dir)*arraySize + d+offset];
+  }
+
+  struct checkpElem &cpAt(int d, int c, int dir)
+  {
+    return checkp[((c%CHECKPRING)*NUMDIRS + dir)*arraySize + d+offset];
+  }
+
+  // cellVal() - the distance along A held in a cell.  It is kept +1,
+  // so BIG_NEGATIVE can be 0.  Past lenA a cell is dead (it can only
+  // move further along A) so values are capped at lenA+1 to fit.
+  int cellVal(const struct ukkElem &e)
+  {
+    return (e.val==0 ? BIG_NEGATIVE : (int)e.val-1);
+  }
+
+  void setCell(int d, int c, int dir, int val)
+  {
+    at(d, c, dir).val   = (val<0 ? 0 : MIN2(val, lenA+1)+1);
+    at(d, c, dir).epoch = epoch;
+#ifdef DEBUG
+    at(d, c, dir).cost  = c;
+#endif
+  }
+
+  // growBand() - make room for diagonals out to c+1 either side (as
+  //   used by costs up to c), keeping the cells already calculated.
+  //   Only needed while the final cost is still unknown.
+  void growBand(int c)
+  {
+    if (data && c+1 <= offset) return;
+
+    int newOffset = MAX2(c+1, 2*offset);
+    int newSize = 2*newOffset+1;
+    struct ukkElem *newData = new struct ukkElem[newSize*MODSIZE*NUMDIRS];
+    struct checkpElem *newCheckp =
+      new struct checkpElem[newSize*CHECKPRING*NUMDIRS];
+
+    for (int i=0; i<newSize*MODSIZE*NUMDIRS; i++)
+      newData[i].epoch = 0;
+    for (int i=0; i<newSize*CHECKPRING*NUMDIRS; i++)
+      newCheckp[i].epoch = 0;
+
+    if (data) {			// Move the old band into the middle
+      for (int k=0; k<MODSIZE*NUMDIRS; k++)
+	for (int d=-offset; d<=offset; d++)
+	  newData[k*newSize + d+newOffset] = data[k*arraySize + d+offset];
+      for (int k=0; k<CHECKPRING*NUMDIRS; k++)
+	for (int d=-offset; d<=offset; d++)
+	  newCheckp[k*newSize + d+newOffset] = checkp[k*arraySize + d+offset];
+    }
+
+    delete[] data;
+    delete[] checkp;
+    data = newData;
+    checkp = newCheckp;
+    offset = newOffset;
+    arraySize = newSize;
+  }
+
+  // clearStamps() - mark every cell and check-point as empty
+  void clearStamps()
+  {
+    for (int i=0; i<arraySize*MODSIZE*NUMDIRS; i++) // Initialize the main
+      data[i].epoch = 0;			     // structure
+
+    for (int i=0; i<arraySize*CHECKPRING*NUMDIRS; i++) // Initialize the
+      checkp[i].epoch = 0;				// checkpoint structure
+  }
+
   void storeCheckp(int c, int d, direction dir, int dist,
 		   int fromCost, int fromDiag, direction fromDir)
   {
-    checkp[d+offset][c%CHECKPSIZE][dir].cost = c;
-    checkp[d+offset][c%CHECKPSIZE][dir].diag = d;
-    checkp[d+offset][c%CHECKPSIZE][dir].entryDir = dir;
-    checkp[d+offset][c%CHECKPSIZE][dir].dist = dist;
-    checkp[d+offset][c%CHECKPSIZE][dir].fromCost = fromCost;
-    checkp[d+offset][c%CHECKPSIZE][dir].fromDiag = fromDiag;
-    checkp[d+offset][c%CHECKPSIZE][dir].fromDir  = fromDir;
+    cpAt(d, c, dir).cost = c;
+    cpAt(d, c, dir).diag = d;
+    cpAt(d, c, dir).entryDir = dir;
+    cpAt(d, c, dir).dist = dist;
+    cpAt(d, c, dir).fromCost = fromCost;
+    cpAt(d, c, dir).fromDiag = fromDiag;
+    cpAt(d, c, dir).fromDir  = fromDir;
+    cpAt(d, c, dir).epoch    = epoch;
   }
 
   int Ukk(int sDiag, int sCost, direction matrix, int d, int c)
@@ -116,15 +219,17 @@ private:
     if (abs(d-sDiag) > c-sCost)
       return BIG_NEGATIVE;	//Boundary condition
 
-    if (data[d+offset][c%MODSIZE][matrix].done)	// Check if already calculated
-      if (data[d+offset][c%MODSIZE][matrix].cost==c)
-        return data[d+offset][c%MODSIZE][matrix].val;
-      else {
+    if (at(d, c, matrix).epoch == epoch) { // Check if already calculated
+#ifdef DEBUG
+      if (at(d, c, matrix).cost!=c) {
         fprintf(stderr,"INTERNAL ERROR: Use of column that is not correct");
         fprintf(stderr,"\nCost = %d,  Diag = %d, (sCost=%d)  (Cost in Matrix=%d)\n",
-                c,d,sCost,data[d+offset][c%MODSIZE][matrix].cost);
+                c,d,sCost,at(d, c, matrix).cost);
         exit(-1);
       }
+#endif
+      return cellVal(at(d, c, matrix));
+    }
 
 #ifdef DEBUG    
     depth+=2;
@@ -136,13 +241,13 @@ private:
     // Must calculate if not previously done.
     switch (matrix) {
      case diag : 
-      v1 = Ukk(sDiag,sCost, diag, d, c-MismatchCost)+1; 
-      v2 = Ukk(sDiag,sCost, horz, d, c-MismatchCost)+1; 
-      v3 = Ukk(sDiag,sCost, vert, d, c-MismatchCost)+1;
+      v1 = Ukk(sDiag,sCost, diag, d, c-Cost::MismatchCost)+1; 
+      v2 = Ukk(sDiag,sCost, horz, d, c-Cost::MismatchCost)+1; 
+      v3 = Ukk(sDiag,sCost, vert, d, c-Cost::MismatchCost)+1;
       switch (fromDir=MAXDIR3(v1,v2,v3)) {
-      case diag : res = v1; fromCost = c-MismatchCost; break;
-      case horz : res = v2; fromCost = c-MismatchCost; break;
-      case vert : res = v3; fromCost = c-MismatchCost; break;
+      case diag : res = v1; fromCost = c-Cost::MismatchCost; break;
+      case horz : res = v2; fromCost = c-Cost::MismatchCost; break;
+      case vert : res = v3; fromCost = c-Cost::MismatchCost; break;
       default :	assert(0);
       }
 
@@ -163,26 +268,26 @@ private:
       while (res>=0 && res<lenA && A[res] == B[res-d]) res++;
       break;
     case horz : 
-      v1 = Ukk(sDiag,sCost, diag, d+1, c-a-b); 
-      v2 = Ukk(sDiag,sCost, horz, d+1, c-b); 
-      v3 = Ukk(sDiag,sCost, vert, d+1, c-a-b);
+      v1 = Ukk(sDiag,sCost, diag, d+1, c-Cost::a-Cost::b); 
+      v2 = Ukk(sDiag,sCost, horz, d+1, c-Cost::b); 
+      v3 = Ukk(sDiag,sCost, vert, d+1, c-Cost::a-Cost::b);
       switch (fromDir=MAXDIR3(v1,v2,v3)) {
-      case diag : res = v1; ; fromCost = c-a-b; break;
-      case horz : res = v2; ; fromCost = c-b; break;
-      case vert : res = v3; ; fromCost = c-a-b; break;
+      case diag : res = v1; ; fromCost = c-Cost::a-Cost::b; break;
+      case horz : res = v2; ; fromCost = c-Cost::b; break;
+      case vert : res = v3; ; fromCost = c-Cost::a-Cost::b; break;
       default :	assert(0);
       }
       fromDiag = d+1;
       
       break;
     case vert : 
-      v1 = Ukk(sDiag,sCost, diag, d-1, c-a-b) + 1; 
-      v2 = Ukk(sDiag,sCost, horz, d-1, c-a-b) + 1; 
-      v3 = Ukk(sDiag,sCost, vert, d-1, c-b) + 1;
+      v1 = Ukk(sDiag,sCost, diag, d-1, c-Cost::a-Cost::b) + 1; 
+      v2 = Ukk(sDiag,sCost, horz, d-1, c-Cost::a-Cost::b) + 1; 
+      v3 = Ukk(sDiag,sCost, vert, d-1, c-Cost::b) + 1;
       switch (fromDir=MAXDIR3(v1,v2,v3)) {
-      case diag : res = v1; fromCost = c-a-b; break;
-      case horz : res = v2; fromCost = c-a-b; break;
-      case vert : res = v3; fromCost = c-b; break;
+      case diag : res = v1; fromCost = c-Cost::a-Cost::b; break;
+      case horz : res = v2; fromCost = c-Cost::a-Cost::b; break;
+      case vert : res = v3; fromCost = c-Cost::b; break;
       default :	assert(0);
       }
       fromDiag = d-1;
@@ -192,18 +297,18 @@ private:
     }
 
     if (res<0) res=BIG_NEGATIVE;
+    if (res<=lenA && res>furthest) furthest = res;
 
-    data[d+offset][c%MODSIZE][matrix].val  = res; // Store the result in the 
-    data[d+offset][c%MODSIZE][matrix].done = 1;   // data array
-    data[d+offset][c%MODSIZE][matrix].cost = c;
+    setCell(d, c, matrix, res);	// Store the result in the data array
 
     if (c<=checkpCost && c>checkpCost-(CHECKPSIZE-1)) {
       // This is on a checkpoint column (cost) so checkpoint it.
       storeCheckp(c, d, matrix, res, fromCost, fromDiag, fromDir);
-    } else if (checkp[fromDiag+offset][fromCost%CHECKPSIZE][fromDir].cost>=0) {
+    } else if (fromCost>=sCost &&
+	       cpAt(fromDiag, fromCost, fromDir).epoch==epoch) {
       // Update checkpoint information if where step from had checkpoint info
-      checkp[d+offset][c%CHECKPSIZE][matrix] =
-	checkp[fromDiag+offset][fromCost%CHECKPSIZE][fromDir];
+      cpAt(d, c, matrix) =
+	cpAt(fromDiag, fromCost, fromDir);
     }
 
 
@@ -221,52 +326,67 @@ private:
     return res;			//Return the length obtainable on diag for cost
   }
 
+  // doUkk() - display the alignment from (sDiag,sCost,sDir,sDist) to
+  //   the end of diagonal fDiag at fCost (in fDir).  Only the top level
+  //   is called with fCost (and fDir) unknown, as -1.  It then goes on
+  //   until the end of the strings is reached, and check-points at the
+  //   first cost to get half way along A (like CPonDist in
+  //   ../align3str_checkp/ukk.checkp.c).  Returns the final distance,
+  //   and the final cost in *costFound if asked.
   int doUkk(int sDiag, int sCost, direction sDir, int sDist,
-	    int fDiag, int fCost, direction fDir)
+	    int fDiag, int fCost, direction fDir, int *costFound=NULL)
   {
     int cost;
     int finalDist;
+    int costKnown = (fCost>=0);
+
+    if (!costKnown && fDiag==sDiag && sDist>=lenA)
+      fCost = sCost;		// Already at the end
+    if (costFound) *costFound = fCost;
 
     if (fCost==sCost)
       return sDist;
 
-    for (int i=0; i<arraySize;i++) // Initialize the main structure
-      for (int j=0; j<MODSIZE; j++) 
-	for (int k=0; k<NUMDIRS; k++)
-	  data[i][j][k].done = 0;
-
-    for (int i=0; i<arraySize; i++) // Initialize the checkpoint structure
-      for (int j=0; j<CHECKPSIZE; j++)
-	for (int k=0; k<NUMDIRS; k++)
-	  checkp[i][j][k].cost = BIG_NEGATIVE;
+    if (++epoch == (1<<EPOCH_BITS)) { // Forget everything from other calls
+      clearStamps();
+      epoch = 1;
+    }
 
     if (fDiag == sDiag)	     // Determine what cost calulation should start at
       cost = sCost + 1;
     else
       cost = sCost + abs(fDiag-sDiag);
 
-    // Calculate what cost to checkpoint at.
-    checkpCost = (fCost+cost+(CHECKPSIZE-1))/2;	
+    // Calculate what cost to checkpoint at.  If fCost isn't known yet
+    // it is decided on the way (below).
+    if (costKnown)
+      checkpCost = (fCost+cost+(CHECKPSIZE-1))/2;	
+    else {
+      checkpCost = INT_MAX;
+      furthest = sDist;
+    }
 
-    data[sDiag+offset][sCost%MODSIZE][sDir].val  = sDist; //Fill in first point
-    data[sDiag+offset][sCost%MODSIZE][sDir].cost = sCost;
-    data[sDiag+offset][sCost%MODSIZE][sDir].done = 1;
+    setCell(sDiag, sCost, sDir, sDist); //Fill in first point
 
     if (sCost<=checkpCost && sCost>checkpCost-(CHECKPSIZE-1))
       storeCheckp(sCost, sDiag, sDir, sDist, sCost, sDiag, sDir);
     
     do { // Main loop.
+      if (!costKnown)
+	growBand(cost);
 
       // ----------------------------------------
       // Blank out the entries that will be calculated on this iteration
-      // Corresponds to 2 diagonals from the point [diag][cost].
-      for (int i=cost-MODSIZE,j=fDiag; i-sCost>=j-sDiag; i--,j++) {
+      // Corresponds to 2 diagonals from the point [diag][cost], as far
+      // as the edge of the cone from the start point (cells outside
+      // it are never calculated).
+      for (int i=cost-MODSIZE,j=fDiag; i-sCost>=abs(j-sDiag); i--,j++) {
 	for (int k=0; k<NUMDIRS; k++)
-	  data[j+offset][i%MODSIZE][k].done = 0;
+	  at(j, i, k).epoch = 0;
       }
-      for (int i=cost-MODSIZE,j=fDiag; i-sCost>=-(j-sDiag); i--,j--) {
+      for (int i=cost-MODSIZE,j=fDiag; i-sCost>=abs(j-sDiag); i--,j--) {
 	for (int k=0; k<NUMDIRS; k++)
-	  data[j+offset][i%MODSIZE][k].done = 0;
+	  at(j, i, k).epoch = 0;
       }
       // ----------------------------------------
 
@@ -278,18 +398,32 @@ private:
 	int v3 = Ukk(sDiag, sCost, vert, fDiag, cost);
 	int v1 = Ukk(sDiag, sCost, diag, fDiag, cost);
 	finalDist = MAX3(v1,v2,v3);
+	if (!costKnown && finalDist>=lenA)
+	  fCost = cost;
 	if (cost == fCost)
 	  fDir = MAXDIR3(v1,v2,v3);
       } else
 	finalDist = Ukk(sDiag, sCost, fDir, fDiag, cost);
+
+      // Half way along A, so check-point on the next costs, none of
+      // which have been calculated yet.
+      if (!costKnown && checkpCost==INT_MAX && furthest>=lenA/2)
+	checkpCost = cost+(CHECKPSIZE-1);
       
       cost++;
     } while ((cost-1) != fCost);
     cost--;
 
+    if (costFound) *costFound = fCost;
+
     // Now do checkpoint recursion--------------------------------------------
-    struct checkpElem cdata = checkp[fDiag+offset][fCost%CHECKPSIZE][fDir];
-    if (cdata.cost<0) {
+    struct checkpElem cdata = cpAt(fDiag, fCost, fDir);
+    if (!costKnown && cdata.epoch!=epoch) {
+      // Got to the end before the check-point costs were done.  Now
+      // fCost is known, so do it all over again.
+      return doUkk(sDiag, sCost, sDir, sDist, fDiag, fCost, fDir);
+    }
+    if (cdata.epoch!=epoch) {
       fprintf(stderr,"INTERNAL ERROR: No data checkpointed\n");
       fprintf(stderr,"sCost=%d sDiag=%d sDir=%d  fCost=%d fDiag=%d fDir=%d"
 	      " checkpCost=%d\n",sCost,sDiag,sDir,fCost,fDiag,fDir,checkpCost);
@@ -320,14 +454,21 @@ private:
   }
 
 public:
-  // editCost() - Calculate edit distance and display the alignment between
-  //              two strings A and B.
-  int align(char strA[], char strB[], int fCost)
+  UkkonenCheckp() : data(NULL), checkp(NULL), offset(0), arraySize(0) {}
+
+  ~UkkonenCheckp()
+  {
+    delete[] data;
+    delete[] checkp;
+  }
+
+  // align() - Calculate edit distance and display the alignment between
+  //           two strings A and B, in the one pass.
+  int align(char strA[], char strB[])
   {
     int cost;
     int finalDiag;
     int sDist;
-    int maxEditdist;
 
     A = strA;
     B = strB;
@@ -335,16 +476,18 @@ public:
     lenB = strlen(B);
     finalDiag = lenA-lenB;
 
-    maxEditdist = (lenA>lenB) ? lenA : lenB; // Maximum possible edit distance.
-    maxEditdist *= MODSIZE;	// This is an upper bound (I think)
-
-    offset = (maxEditdist-finalDiag)/2; // Offset to allow for -ve diagonals
-    
-    // Now allocate storage. Largest possible edit distance by 3 columns needed
-    data  = new struct ukkElem[maxEditdist+1][MODSIZE][NUMDIRS];
-    arraySize = maxEditdist+1;
-
-    checkp = new struct checkpElem[maxEditdist+1][CHECKPSIZE][NUMDIRS];
+    // Storage is a band of diagonals around diagonal 0.  Each step off
+    // a diagonal costs at least 1, so no cell used is more than the
+    // cost diagonals from diagonal 0.  A 'from' cell outside that band
+    // may be looked at, so allow 1 more.  growBand() widens it as the
+    // cost goes up, so it ends up O(final cost).
+    delete[] data;
+    delete[] checkp;
+    data = NULL;
+    checkp = NULL;
+    offset = arraySize = 0;
+    growBand(abs(finalDiag));
+    epoch = 0;
 
     
     // Calculate and display the initial matchings of A and B. (For entry 0,0
@@ -352,12 +495,315 @@ public:
     for (sDist=0; A[sDist] && A[sDist]==B[sDist]; sDist++) 
       printf("[%c,%c] ",A[sDist],B[sDist]);
 
-    cost = doUkk(0, 0, diag, sDist, finalDiag, fCost, nodir);
+    doUkk(0, 0, diag, sDist, finalDiag, -1, nodir, &cost);
     
     return cost;
   }
 };
 
+				// Costs below this are aligned directly
+				// from all the wavefronts (O(cost^2) space)
+#define BI_MINCOST   MAX2(64, 4*WFSIZE)
+				// Costs from this up run the two directions
+				// on a thread each
+#define BI_THREADCOST 1000
+				// Costs the wavefronts are run on at a time
+				// while the edit cost is not yet known
+#define BI_CHUNK      32
+
+// Bidirectional version of the check-pointing (in the style of BiWFA,
+// S. Marco-Sola, J. M. Eizenga, A. Guarracino, B. Paten, E. Garrison
+// and M. Moreto, "Optimal gap-affine alignment in O(s) space",
+// Bioinformatics, 2023, 39:2).  Instead of carrying check-point data
+// forward from the middle cost, each level runs wavefronts forward
+// from the start to half the cost, and backwards from the end, and
+// splits the alignment where the two meet.  At the top level the cost
+// is not known: both directions are run on until they first meet,
+// which gives the edit cost as well as the split.
+template <class Cost>
+class UkkonenBi
+{
+  typedef typename Ukkonen<Cost>::direction direction;
+  typedef typename Ukkonen<Cost>::wavefront wavefront;
+  static const direction horz = Ukkonen<Cost>::horz;
+  static const direction vert = Ukkonen<Cost>::vert;
+  static const direction diag = Ukkonen<Cost>::diag;
+
+  char *A, *B;			// Two strings to be aligned
+  int lenA,lenB;		// Length of the two strings
+  char *rA, *rB;		// A and B reversed
+
+  Ukkonen<Cost> fwd;		// Wavefronts from the start
+  Ukkonen<Cost> rev;		// Wavefronts from the end (on rA and rB)
+  Ukkonen<Cost> all;		// Every wavefront, for small costs
+
+  int fDone, rDone;		// Costs fwd and rev have been run to
+
+  struct runArgs {
+    Ukkonen<Cost> *u;
+    int cost;
+  };
+
+  // The split found by findSplit()
+  struct splitType {
+    int p;			// Cost of the part before it
+    direction state;		// State the path is in there
+    int d, dist;		// Its diagonal, and point along A
+  };
+
+private:
+  static void *runFronts(void *p)
+  {
+    struct runArgs *r = (struct runArgs *)p;
+    r->u->extendTo(r->cost);
+    return NULL;
+  }
+
+  // display() - Show an alignment that was traced back (so is in
+  //             reverse order)
+  void display(char *ch1, char *ch2, int n)
+  {
+    for (int k=n-1; k>=0; k--) {
+      if (ch1[k] == ch2[k])
+	printf("[%c,%c] ", ch1[k], ch2[k]);
+      else
+	printf("<%c,%c> ", ch1[k], ch2[k]);
+    }
+  }
+
+  // traceBack() - align the piece directly, keeping every wavefront.
+  //               Arguments are as for biAlign().
+  void traceBack(int sA, int lA, int sB, int lB,
+		 direction sState, direction fState, int cost)
+  {
+    char *a = A+sA, *b = B+sB;
+    char *ch1 = new char[lA+lB], *ch2 = new char[lA+lB];
+    int n = 0;
+    int d = lA-lB, i = lA, c = cost;
+    direction state = fState;
+
+    all.start(a, lA, b, lB, sState, 0);
+    all.extendTo(cost);
+    if (all.get(all.front(cost), fState, d) != lA) {
+      fprintf(stderr,"INTERNAL ERROR: End not reached at cost %d\n", cost);
+      exit(-1);
+    }
+
+    while (c>0 || (state==diag && i>0)) {
+      if (state == diag) {
+	int m = BIG_NEGATIVE, h, v;
+	if (c > 0) {
+	  m = all.get(all.front(c-Cost::MismatchCost), state, d) + 1;
+	  if (m > lA || m-d > lB) m = BIG_NEGATIVE;
+	}
+	h = all.get(all.front(c), horz, d);
+	v = all.get(all.front(c), vert, d);
+	if (c == 0) m = 0;	// The start, after any gap carried on
+
+	for (; i>MAX3(m,h,v); i--, n++) { // The run of matches
+	  ch1[n] = a[i-1];
+	  ch2[n] = b[i-1-d];
+	}
+	if (c == 0) break;
+	if (m >= h && m >= v) {
+	  ch1[n] = a[i-1];
+	  ch2[n] = b[i-1-d];
+	  n++;
+	  i--;
+	  c -= Cost::MismatchCost;
+	} else
+	  state = (h >= v ? horz : vert);
+      } else if (state == horz) {
+	ch1[n] = '-';
+	ch2[n] = b[i-1-d];
+	n++;
+	d++;
+	if (all.get(all.front(c-Cost::b), state, d) == i)
+	  c -= Cost::b;
+	else {
+	  c -= Cost::a+Cost::b;
+	  state = diag;
+	}
+      } else {
+	ch1[n] = a[i-1];
+	ch2[n] = '-';
+	n++;
+	i--;
+	d--;
+	if (all.get(all.front(c-Cost::b), state, d) == i)
+	  c -= Cost::b;
+	else {
+	  c -= Cost::a+Cost::b;
+	  state = diag;
+	}
+      }
+    }
+
+    display(ch1, ch2, n);
+    delete[] ch1;
+    delete[] ch2;
+  }
+
+  // meet() - look for where the wavefronts of fwd at cost p and rev at
+  //   cost q overlap in 'state'.  Returns the diagonal, or lenA+1 if
+  //   there is none, and in dist the point on it to split at.
+  int meet(int p, int q, direction state, int lA, int lB, int *dist)
+  {
+    wavefront *wf = fwd.front(p), *wr = rev.front(q);
+
+    if (!wf || !wr) return lenA+1;
+
+    // Diagonal d forward is diagonal (lA-lB)-d backwards
+    int lo = MAX2(wf->lo, (lA-lB)-wr->hi);
+    int hi = MIN2(wf->hi, (lA-lB)-wr->lo);
+    for (int d=lo; d<=hi; d++) {
+      int f = fwd.get(wf, state, d), r = rev.get(wr, state, (lA-lB)-d);
+      if (f>=0 && r>=0 && f+r>=lA) {
+	*dist = lA-r;		// Where the backward path got to
+	return d;
+      }
+    }
+    return lenA+1;
+  }
+
+  // runBoth() - run fwd to fCost and rev to rCost, on a thread each
+  //   if 'cost' is big enough
+  void runBoth(int fCost, int rCost, int cost)
+  {
+    struct runArgs fArgs = {&fwd, fCost}, rArgs = {&rev, rCost};
+    pthread_t thread;
+
+    if (cost < BI_THREADCOST ||
+	pthread_create(&thread, NULL, runFronts, &rArgs) != 0) {
+      runFronts(&rArgs);
+      runFronts(&fArgs);
+    } else {
+      runFronts(&fArgs);
+      pthread_join(thread, NULL);
+    }
+    fDone = MAX2(fDone, fCost);
+    rDone = MAX2(rDone, rCost);
+  }
+
+  // findSplit() - where an optimal alignment of A[sA..sA+lA) with
+  //   B[sB..sB+lB) (states as for biAlign()) can be split, in s.
+  //   Tries each total cost from 'cost' up, and returns the first one
+  //   the two directions meet at, which is the edit cost.  If 'known'
+  //   it must be 'cost' itself.  Otherwise the wavefronts are run
+  //   BI_CHUNK costs ahead at a time, so the threads have work to do.
+  int findSplit(int sA, int lA, int sB, int lB,
+		direction sState, direction fState, int cost, int known,
+		struct splitType &s)
+  {
+    fwd.start(A+sA, lA, B+sB, lB, sState, 0);
+    rev.start(rA+lenA-sA-lA, lA, rB+lenB-sB-lB, lB, fState, 1);
+    fDone = rDone = 0;
+
+    for (;; cost++) {
+      // Forwards to half the cost, keeping the last WFSIZE wavefronts.
+      // Some point on an optimal path is within those, and the rest of
+      // the path from it costs no more than rCost, so backwards to
+      // there.  A gap split at the point pays 'a' both ways, hence
+      // the extra a.
+      int fCost = cost/2;
+      int rCost = cost-fCost + WFSIZE-1 + Cost::a;
+      int ahead = (known ? 0 : BI_CHUNK);
+
+      if (fDone < fCost || rDone < rCost)
+	runBoth(fCost + ahead, rCost + ahead, cost);
+
+      // Look for a split.  Through a diagonal step the two costs add
+      // up to 'cost', through a gap 'a' is paid by both.
+      for (s.p=fCost; s.p>fCost-WFSIZE && s.p>=0; s.p--) {
+	s.state = diag;
+	s.d = meet(s.p, cost-s.p, s.state, lA, lB, &s.dist);
+	if (s.d > lenA) {
+	  s.state = horz;
+	  s.d = meet(s.p, cost-s.p+Cost::a, s.state, lA, lB, &s.dist);
+	}
+	if (s.d > lenA) {
+	  s.state = vert;
+	  s.d = meet(s.p, cost-s.p+Cost::a, s.state, lA, lB, &s.dist);
+	}
+	if (s.d <= lenA)
+	  return cost;
+      }
+
+      if (known) {
+	fprintf(stderr,"INTERNAL ERROR: Wavefronts did not meet\n");
+	fprintf(stderr,"sA=%d lA=%d sB=%d lB=%d cost=%d\n",sA,lA,sB,lB,cost);
+	exit(-1);
+      }
+    }
+  }
+
+  // biAlign() - Display an optimal alignment of A[sA..sA+lA) with
+  //   B[sB..sB+lB), which is known to cost 'cost'.  It starts in sState
+  //   (if a gap, carrying on one from the left) and must end in fState
+  //   (if a gap, one that carries on to the right).
+  void biAlign(int sA, int lA, int sB, int lB,
+	       direction sState, direction fState, int cost)
+  {
+    struct splitType s;
+
+    if (cost < BI_MINCOST) {
+      traceBack(sA, lA, sB, lB, sState, fState, cost);
+      return;
+    }
+
+    findSplit(sA, lA, sB, lB, sState, fState, cost, 1, s);
+    splitAlign(sA, lA, sB, lB, sState, fState, cost, s);
+  }
+
+  // splitAlign() - biAlign() the two parts either side of split s
+  void splitAlign(int sA, int lA, int sB, int lB,
+		  direction sState, direction fState, int cost,
+		  struct splitType &s)
+  {
+    biAlign(sA, s.dist, sB, s.dist-s.d, sState, s.state, s.p);
+    biAlign(sA+s.dist, lA-s.dist, sB+s.dist-s.d, lB-(s.dist-s.d),
+	    s.state, fState, cost-s.p);
+  }
+
+public:
+  UkkonenBi() : rA(NULL), rB(NULL), fwd(WFSIZE+BI_CHUNK),
+		rev(WFSIZE+Cost::a+BI_CHUNK), all(0) {}
+
+  ~UkkonenBi()
+  {
+    delete[] rA;
+    delete[] rB;
+  }
+
+  // align() - Display an optimal alignment of A and B.  Returns its
+  //   cost, found by the top level split.
+  int align(char strA[], char strB[])
+  {
+    struct splitType s;
+    int fCost;
+
+    A = strA;
+    B = strB;
+    lenA = strlen(A);
+    lenB = strlen(B);
+
+    delete[] rA;
+    delete[] rB;
+    rA = new char[lenA+1];
+    rB = new char[lenB+1];
+    for (int i=0; i<lenA; i++) rA[i] = A[lenA-1-i];
+    for (int j=0; j<lenB; j++) rB[j] = B[lenB-1-j];
+    rA[lenA] = rB[lenB] = 0;
+
+    fCost = findSplit(0, lenA, 0, lenB, diag, diag, 0, 0, s);
+    if (fCost < BI_MINCOST)
+      traceBack(0, lenA, 0, lenB, diag, diag, fCost);
+    else
+      splitAlign(0, lenA, 0, lenB, diag, diag, fCost, s);
+    return fCost;
+  }
+};
+
 void msg(char *prog) {
   cout << "Copyright (C) David Powell <david@drp.id.au>" << endl;
   cout << "  This program comes with ABSOLUTELY NO WARRANTY; and is provided" << endl;
@@ -381,27 +827,69 @@ void msg(char *prog) {
 
   cout << endl;
 
-  cout << "Usage: " << prog << endl;
+  cout << "3:  S. Marco-Sola, J. M. Eizenga, A. Guarracino, B. Paten, E. Garrison" << endl;
+  cout << "    and M. Moreto, \"Optimal gap-affine alignment in O(s) space\"," << endl;
+  cout << "    Bioinformatics, 2023, 39:2" << endl;
+
+  cout << endl;
+
+  cout << "Usage: " << prog << " [-b] [[matchCost] mismatchCost a b]" << endl;
+  cout << "  where cost for gap of length k = a + b*k" << endl;
+  cout << "  A matchCost other than 0 (e.g. -1 for a bonus) is turned into" << endl;
+  cout << "  equivalent costs with a free match" << endl;
+  cout << "  -b splits where wavefronts from both ends meet(3), instead" << endl;
+  cout << "     of check-pointing.  It is used anyway when b (after any" << endl;
+  cout << "     change for the match cost) is not 1, as the check-pointing" << endl;
+  cout << "     windows rely on b=1" << endl;
   cout << endl << endl;
 }
 
 
+template <class Cost>
+int costAndAlign(char *A, char *B, int bidir)
+{
+  int res;
+
+  if (bidir) {
+    UkkonenBi<Cost> t2;
+    res = t2.align(A,B);
+  } else {
+    UkkonenCheckp<Cost> t2;
+    res = t2.align(A,B);
+  }
+  return res;
+}
+
 int main(int argc, char** argv)
 {
   char A[MAXSTRING],B[MAXSTRING];
   int res;
-  Ukkonen t;
-  UkkonenCheckp t2;
+  int bidir = 0;
 
   msg(argv[0]);
 
-  printf("Match=%d Mis=%d a=%d b=%d\n",MatchCost,MismatchCost,a,b);
+  if (argc>=2 && strcmp(argv[1],"-b")==0) {
+    bidir = 1;
+    argc--;
+    argv++;
+  }
+
+  if (argc==4)
+    setCosts(MatchCost, atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+  else if (argc==5)
+    setCosts(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+  checkCosts();
+  if (RuntimeCosts::b != 1)	// See window_size.note
+    bidir = 1;
+
+  showCosts();
 
   Common::readStrings(A, B);
 
-  res = t.editCost(A, B);
-  t2.align(A,B,res);
-  cout << endl << "Edit Cost = " << res << endl;
+#define TRY_COSTS(m, o, e) IF_COSTS(m, o, e, res = costAndAlign<Cost>(A, B, bidir))
+  COMMON_COSTS(TRY_COSTS)
+    res = costAndAlign<RuntimeCosts>(A, B, bidir);
+  cout << endl << "Edit Cost = " << fromUkkCost(res, strlen(A), strlen(B)) << endl;
   return 0;
 }
 
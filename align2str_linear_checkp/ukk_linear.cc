@@ -42,7 +42,8 @@ void msg(char *prog) {
 
   cout << "This program calculates the edit cost between two strings under linear gap costs, _but_" << endl;
   cout << "does determine an alignment.  This program uses a modified version of Ukkonen's algorithm(1)" << endl;
-  cout << "and has time complexity O(d*d + n) and space complexity O(d) (where d is the edit cost)" << endl;
+  cout << "done as a wavefront(2), and has time complexity O(d*d + n) and space complexity O(d)" << endl;
+  cout << "(where d is the edit cost)" << endl;
 
   cout << endl;
 
@@ -51,24 +52,48 @@ void msg(char *prog) {
 
   cout << endl;
 
-  cout << "Usage: " << prog << endl;
+  cout << "2:  S. Marco-Sola, J. C. Moure, M. Moreto and A. Espinosa," << endl;
+  cout << "    \"Fast gap-affine pairwise alignment using the wavefront algorithm\"," << endl;
+  cout << "    Bioinformatics, 2021, 37:4, pp 456-463" << endl;
+
+  cout << endl;
+
+  cout << "Usage: " << prog << " [[matchCost] mismatchCost a b]" << endl;
+  cout << "  where cost for gap of length k = a + b*k" << endl;
+  cout << "  A matchCost other than 0 (e.g. -1 for a bonus) is turned into" << endl;
+  cout << "  equivalent costs with a free match" << endl;
   cout << endl << endl;
 }
 
+template <class Cost>
+int editCost(char *A, char *B)
+{
+  Ukkonen<Cost> t;
+
+  return t.editCost(A,B);
+}
+
 int main(int argc, char **argv)
 {
   char A[MAXSTRING],B[MAXSTRING];
   int res;
-  Ukkonen t;
 
   msg(argv[0]);
 
-  printf("Match=%d Mis=%d a=%d b=%d\n",MatchCost,MismatchCost,a,b);
+  if (argc==4)
+    setCosts(MatchCost, atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+  else if (argc==5)
+    setCosts(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+  checkCosts();
+
+  showCosts();
 
   Common::readStrings(A, B);
 
-  res = t.editCost(A,B);
-  cout << "Edit cost = " << res << endl;
+#define TRY_COSTS(m, o, e) IF_COSTS(m, o, e, res = editCost<Cost>(A, B))
+  COMMON_COSTS(TRY_COSTS)
+    res = editCost<RuntimeCosts>(A, B);
+  cout << "Edit cost = " << fromUkkCost(res, strlen(A), strlen(B)) << endl;
   return 0;
 }
 
@@ -34,226 +34,378 @@
 
 using namespace std;
 
-#define a 3                     // insert(delete) cost = w(k) = a+b*k
-#define b 1                     // Where k is number or inserts(deletes)
-#define MatchCost    0          // Cost of a match (not used, must be 0)
-#define MismatchCost 1          // Cost of a mismatch
-
-				// Size of window on ukkonen matrix.
-				// For a description of why this size is
-				// necessary read window_size.note
-#define MODSIZE      (MAX2((a+b)*2, MismatchCost)+1)
+#define _a 3                    // insert(delete) cost = w(k) = a+b*k
+#define _b 1                    // Where k is number or inserts(deletes)
+#define MatchCost     0         // Cost of a match (not used, must be 0)
+#define _MismatchCost 1         // Cost of a mismatch
+
+// The costs are a template parameter of the ukk_ classes.
+// FixedCosts<> makes them compile time constants, so the inner loops
+// are compiled for just those costs.  RuntimeCosts holds any other
+// costs (as read from the command line).  Either way they are used as
+// Cost::a, Cost::b and Cost::MismatchCost.
+template <int Mismatch, int Open, int Extend>
+struct FixedCosts {
+  static const int MismatchCost = Mismatch;
+  static const int a = Open;
+  static const int b = Extend;
+};
+
+struct RuntimeCosts {
+  static int MismatchCost;
+  static int a;
+  static int b;
+};
+
+int RuntimeCosts::MismatchCost = _MismatchCost;
+int RuntimeCosts::a = _a;
+int RuntimeCosts::b = _b;
+
+// The costs that get their own copy of the inner loops, as
+// X(MismatchCost, a, b).  Others use RuntimeCosts.
+#define COMMON_COSTS(X) \
+  X(1, 3, 1)		/* The compiled in default */ \
+  X(1, 0, 1)		/* Gaps cost the same as mismatches */ \
+  X(4, 6, 2)		/* Common for DNA reads */
+
+// Use in a COMMON_COSTS() chain: if RuntimeCosts match, do 'run'
+// with those costs as constants.  The chain must be followed by the
+// statement for any other costs.
+#define IF_COSTS(m, o, e, run) \
+  if (RuntimeCosts::MismatchCost==(m) && RuntimeCosts::a==(o) && \
+      RuntimeCosts::b==(e)) { \
+    typedef FixedCosts<m, o, e> Cost; \
+    run; \
+  } else
+
+// Any other match cost (such as a bonus, as a negative cost) is
+// turned into costs with a free match.  An alignment of A and B with
+// x mismatches, and k gaps with g characters in them, has
+// (lenA+lenB-g)/2 - x matches, so
+//   2*cost = match*(lenA+lenB) + 2*(mismatch-match)*x
+//            + 2*a*k + (2*b-match)*g
+// The ukk_ programs align under these doubled costs (with any common
+// factor divided out), and fromUkkCost() maps the cost back.
+static int givenMatchCost = MatchCost;	// Costs asked for
+static int givenMismatchCost, givenA, givenB;
+static int costFactor = 2;		// Factor divided out of 2*cost
+
+static int gcd(int x, int y)
+{
+  x = abs(x);
+  y = abs(y);
+  while (y) {
+    int t = x%y;
+    x = y;
+    y = t;
+  }
+  return x;
+}
+
+// setCosts() - put the costs to align with in RuntimeCosts
+static void setCosts(int match, int mismatch, int a, int b)
+{
+  givenMatchCost = match;
+  givenMismatchCost = mismatch;
+  givenA = a;
+  givenB = b;
+  if (match == MatchCost) {
+    RuntimeCosts::MismatchCost = mismatch;
+    RuntimeCosts::a = a;
+    RuntimeCosts::b = b;
+    return;
+  }
+
+  mismatch = 2*(mismatch-match);
+  a = 2*a;
+  b = 2*b-match;
+  costFactor = MAX2(gcd(gcd(mismatch, a), b), 1);
+  RuntimeCosts::MismatchCost = mismatch/costFactor;
+  RuntimeCosts::a = a/costFactor;
+  RuntimeCosts::b = b/costFactor;
+}
+
+// fromUkkCost() - cost, under the costs given to setCosts(), of an
+// alignment of A and B that costs c under RuntimeCosts
+static int fromUkkCost(int c, int lenA, int lenB)
+{
+  if (givenMatchCost == MatchCost) return c;
+  return (givenMatchCost*(lenA+lenB) + costFactor*c)/2;
+}
+
+// checkCosts() - the ukk_ programs need a match to be free, and
+// every other step to cost something, so the costs keep going up.
+static void checkCosts()
+{
+  if (RuntimeCosts::MismatchCost < 1 || RuntimeCosts::b < 1 ||
+      RuntimeCosts::a < 0) {
+    if (givenMatchCost == MatchCost)
+      cerr << "Costs must have mismatchCost>=1, a>=0 and b>=1" << endl;
+    else
+      cerr << "Costs must have mismatchCost>matchCost, a>=0 and "
+	   << "2*b>matchCost" << endl;
+    exit(1);
+  }
+}
+
+// showCosts() - display the costs given, and any they were turned into
+static void showCosts()
+{
+  if (givenMatchCost == MatchCost) {
+    printf("Match=%d Mis=%d a=%d b=%d\n",MatchCost,RuntimeCosts::MismatchCost,
+	   RuntimeCosts::a,RuntimeCosts::b);
+    return;
+  }
+  printf("Match=%d Mis=%d a=%d b=%d\n",givenMatchCost,givenMismatchCost,
+	 givenA,givenB);
+  printf("  aligned as Match=%d Mis=%d a=%d b=%d\n",MatchCost,
+	 RuntimeCosts::MismatchCost,RuntimeCosts::a,RuntimeCosts::b);
+}
+
+				// Number of costs worth of wavefronts kept.
+				// Each step looks back at most this far.
+#define WFSIZE       (MAX2(Cost::a+Cost::b, Cost::MismatchCost)+1)
     
 
 #define BIG_NEGATIVE -BIG_VAL
 
+// Ukkonen's algorithm for linear (affine) gap costs, done as a wave
+// front (S. Marco-Sola, J. C. Moure, M. Moreto and A. Espinosa, "Fast
+// gap-affine pairwise alignment using the wavefront algorithm",
+// Bioinformatics, 2021, 37:4, pp 456-463).  For each cost, in turn,
+// and each diagonal d=i-j, it finds the furthest point along A that
+// can be reached in each state.  Only the last few costs are kept.
+template <class Cost>
 class Ukkonen
 {
-  struct ukkElem {
-    int val;		     // Contents of this cell
-    int column;              // Column of this cell (used for debugging)
-    int done;		     // Flag for whether this cell has been calculated
-  };
-  
+public:
   enum direction {horz, vert, diag};
+
+  // The wavefront for one cost.  Arrays are indexed by diagonal-lo
+  struct wavefront {
+    int cost;			// Cost this is for, -1 if not yet used
+    int lo, hi;			// Diagonals covered (empty if lo>hi)
+    int size;			// Diagonals room has been made for
+    int *far[3];		// Furthest point along A for each state
+  };
   
+private:
   char *A, *B;			// Two strings to be aligned
   int lenA,lenB;		// Length of the two strings
-  struct ukkElem (*diagArray)[MODSIZE];
-  struct ukkElem (*horzArray)[MODSIZE];
-  struct ukkElem (*vertArray)[MODSIZE];
-  
-  int offset;			// Offset into data[] because -ve indices
-				// needed.
-  int arraySize;		// Number of rows allocated for each array
+  struct wavefront *wf;		// The last 'keep' wavefronts
+  int keep;			// Number of wavefronts kept, 0 for all
+  int numFronts;		// Size of wf[]
+  int cost;			// Highest cost worked out so far
 
-#if DEBUG
-  int depth=-2;
-#endif
+  direction firstState;		// A gap that must be the first step
+  int firstCost;		// (see start()), its cost or -1
 
-private:
-  int Ukk(int sDiag, int sCost, direction matrix, int d, int c)
+  // slot() - where the wavefront for cost c goes in wf[]
+  struct wavefront *slot(int c)
   {
-    int v1,v2,v3,res;
-    struct ukkElem (*data)[MODSIZE];	// Pointer to the desired array
+    if (keep) return &wf[c%keep];
+
+    if (c >= numFronts) {	// Keeping them all, so make room
+      int n = MAX2(c+1, 2*numFronts);
+      struct wavefront *w = new struct wavefront[n];
+      for (int k=0; k<n; k++) {
+        if (k<numFronts) {
+          w[k] = wf[k];
+          continue;
+        }
+        w[k].cost = -1;
+        w[k].size = 0;
+        for (int dir=0; dir<3; dir++)
+          w[k].far[dir] = NULL;
+      }
+      delete[] wf;
+      wf = w;
+      numFronts = n;
+    }
+    return &wf[c];
+  }
 
-    switch (matrix) {
-    case diag: data = diagArray; break;
-    case horz: data = horzArray; break;
-    case vert: data = vertArray; break;
+  // reserve() - make room for n diagonals in w.  The band only grows
+  // by a couple of diagonals each cost, so double to keep this rare.
+  // Old contents are not kept.
+  void reserve(struct wavefront *w, int n)
+  {
+    if (n <= w->size) return;
+    w->size = MAX2(n, 2*w->size);
+    for (int dir=0; dir<3; dir++) {
+      delete[] w->far[dir];
+      w->far[dir] = new int[w->size];
     }
-  
-//    if (d==sDiag && c==sCost) return sDistance; // Starting condition
+  }
 
-#if DEBUG
-    for (v1=0;v1<depth+2;v1++)
-      printf(" ");
-    printf("D=%d C=%d DIR=%s\n",d,c,
-	   (matrix==diag ? "Diag" : (matrix==horz ? "Horz" : "Vert")));
+  // extend() - follow matches down diagonal d from A[i].  Compares a
+  // word at a time where the byte order allows it.
+  int extend(int d, int i)
+  {
+    int j = i-d;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (i+8<=lenA && j+8<=lenB) {
+      unsigned long long x,y;
+      memcpy(&x, A+i, 8);
+      memcpy(&y, B+j, 8);
+      if (x != y)
+        return i + (__builtin_ctzll(x^y) >> 3);
+      i += 8;
+      j += 8;
+    }
 #endif
-    
-    
-    if (abs(d-sDiag) > c-sCost)
-      return BIG_NEGATIVE;	//Boundary condition
-
-    if (data[d+offset][c%MODSIZE].done)	// Check if already calculated
-      if (data[d+offset][c%MODSIZE].column==c)
-        return data[d+offset][c%MODSIZE].val;
-      else {
-        fprintf(stderr,"INTERNAL ERROR: Use of column that is not correct");
-        fprintf(stderr,"\nCost = %d,  Diag = %d,   (Cost in Matrix=%d)\n",
-                c,d,data[d+offset][c%MODSIZE].column);
-        exit(-1);
-      }
+    while (i<lenA && j<lenB && A[i]==B[j]) {
+      i++;
+      j++;
+    }
+    return i;
+  }
 
-#ifdef DEBUG    
-    depth+=2;
-    for (v1=0;v1<depth;v1++)
-      printf(" ");
-    printf("Depends on:\n");
-#endif
-    
-    // Must calculate if not previously done.
-    switch (matrix) {
-     case diag: 
-      v1 = Ukk(sDiag,sCost, diag, d, c-MismatchCost)+1; 
-      v2 = Ukk(sDiag,sCost, horz, d, c-MismatchCost)+1; 
-      v3 = Ukk(sDiag,sCost, vert, d, c-MismatchCost)+1;
-      res = MAX3(v1,v2,v3);
-
-
-      v2 = Ukk(sDiag,sCost, horz, d, c);
-      if (v2>=0 && v2<lenA && A[v2] == B[v2-d])
-	res = MAX2(v2,res);
-      
-      v3 = Ukk(sDiag,sCost, vert, d, c);
-      if (v3>=0 && v3<lenA && A[v3] == B[v3-d])
-	res = MAX2(v3,res);
-	
-      // Extend the diagonal if possible (only done for diagonal step)
-      while (res>=0 && res<lenA && A[res] == B[res-d]) res++;
-      break;
-    case horz: 
-      v1 = Ukk(sDiag,sCost, diag, d+1, c-a-b); 
-      v2 = Ukk(sDiag,sCost, horz, d+1, c-b); 
-      v3 = Ukk(sDiag,sCost, vert, d+1, c-a-b);
-      res = MAX3(v1,v2,v3);
-      break;
-    case vert: 
-      v1 = Ukk(sDiag,sCost, diag, d-1, c-a-b) + 1; 
-      v2 = Ukk(sDiag,sCost, horz, d-1, c-a-b) + 1; 
-      v3 = Ukk(sDiag,sCost, vert, d-1, c-b) + 1;
-      res = MAX3(v1,v2,v3);
-      break;
+  // nextFront() - work out the wavefront for cost c from those before
+  void nextFront(int c)
+  {
+    struct wavefront *w = slot(c);
+    struct wavefront *wMis  = front(c-Cost::MismatchCost); // diag after mismatch
+    struct wavefront *wOpen = front(c-Cost::a-Cost::b);	   // Start a gap
+    struct wavefront *wExt  = front(c-Cost::b);		   // Continue a gap
+    int firstDiag = (firstState==horz ? -1 : 1);
+    int d;
+
+    w->cost = c;
+    w->lo = lenA+1;
+    w->hi = -lenB-1;
+    if (wMis)  { w->lo = MIN2(w->lo, wMis->lo);    w->hi = MAX2(w->hi, wMis->hi); }
+    if (wOpen) { w->lo = MIN2(w->lo, wOpen->lo-1); w->hi = MAX2(w->hi, wOpen->hi+1); }
+    if (wExt)  { w->lo = MIN2(w->lo, wExt->lo-1);  w->hi = MAX2(w->hi, wExt->hi+1); }
+    if (c == firstCost) {
+      w->lo = MIN2(w->lo, firstDiag);
+      w->hi = MAX2(w->hi, firstDiag);
+    }
+    w->lo = MAX2(w->lo, -lenB);
+    w->hi = MIN2(w->hi, lenA);
+    reserve(w, w->hi - w->lo + 1);
+
+    for (d=w->lo; d<=w->hi; d++) {
+      int h,v,m;
+
+      // horz - a char of B against a gap, from diagonal d+1
+      h = MAX2(get(wOpen, diag, d+1), get(wExt, horz, d+1));
+      if (c == firstCost && d == firstDiag && firstState == horz)
+        h = 0;
+      if (h-d > lenB) h = BIG_NEGATIVE;
+
+      // vert - a char of A against a gap, from diagonal d-1
+      v = MAX2(get(wOpen, diag, d-1), get(wExt, vert, d-1)) + 1;
+      if (c == firstCost && d == firstDiag && firstState == vert)
+        v = 1;
+      if (v > lenA) v = BIG_NEGATIVE;
+
+      // diag - a mismatch, or a gap ending here, then any matches
+      m = get(wMis, diag, d) + 1;
+      if (m > lenA || m-d > lenB) m = BIG_NEGATIVE;
+      m = MAX3(m, h, v);
+      if (m >= 0) m = extend(d, m);
+
+      w->far[horz][d-w->lo] = (h<0 ? BIG_NEGATIVE : h);
+      w->far[vert][d-w->lo] = (v<0 ? BIG_NEGATIVE : v);
+      w->far[diag][d-w->lo] = (m<0 ? BIG_NEGATIVE : m);
     }
+  }
 
-    if (res<0) res=BIG_NEGATIVE;
+public:
+  // keep - how many of the latest wavefronts to keep, at least WFSIZE.
+  //        0 keeps them all (to trace an alignment back through).
+  Ukkonen(int n = WFSIZE) : wf(NULL), keep(n), numFronts(0)
+  {
+    if (keep) {
+      numFronts = keep;
+      wf = new struct wavefront[numFronts];
+      for (int k=0; k<numFronts; k++) {
+        wf[k].size = 0;
+        for (int dir=0; dir<3; dir++)
+          wf[k].far[dir] = NULL;
+      }
+    }
+  }
 
-    data[d+offset][c%MODSIZE].val = res; // Store the result in the data array
-    data[d+offset][c%MODSIZE].done= 1;
-    data[d+offset][c%MODSIZE].column = c;
+  ~Ukkonen()
+  {
+    for (int k=0; k<numFronts; k++)
+      for (int dir=0; dir<3; dir++)
+        delete[] wf[k].far[dir];
+    delete[] wf;
+  }
 
-#ifdef DEBUG
-    depth-=2;
-#endif
-    
-    return res;			//Return the length obtainable on diag for cost
+  // front() - the wavefront for cost c, NULL if there isn't one
+  struct wavefront *front(int c)
+  {
+    if (c<0 || c>cost) return NULL;
+    struct wavefront *w = &wf[keep ? c%keep : c];
+    return (w->cost == c ? w : NULL);
   }
 
-  int doUkk(int sDiag, int sCost, int sDist, int fDiag)
+  // get() - furthest point on diagonal d of one state of a wavefront
+  int get(struct wavefront *w, direction state, int d)
   {
-    int cost, dist;
+    if (!w || d<w->lo || d>w->hi) return BIG_NEGATIVE;
+    return w->far[state][d-w->lo];
+  }
 
-    for (int i=0; i<arraySize;i++) { // Initialize the main structure
-      for (int j=0; j<MODSIZE; j++) {
-	diagArray[i][j].done = 0;
-	horzArray[i][j].done = 0;
-	vertArray[i][j].done = 0;
-      }
-    }
+  // start() - set up the cost 0 wavefront for aligning strA (length
+  //   lA) with strB (length lB), starting in 'state'.  A gap state
+  //   normally carries on a gap from before, so extending it costs
+  //   only b.  With firstStep set it must instead be the first step,
+  //   and pays a+b (as when going backwards from the end of a gap).
+  void start(char *strA, int lA, char *strB, int lB,
+	     direction state, int firstStep)
+  {
+    A = strA;
+    B = strB;
+    lenA = lA;
+    lenB = lB;
 
-    if (fDiag == sDiag)	     // Determine what cost calulation should start at
-      cost = sCost + 1;
-    else
-      cost = sCost + abs(fDiag-sDiag);
-    
-    diagArray[sDiag+offset][sCost%MODSIZE].val = sDist;
-    diagArray[sDiag+offset][sCost%MODSIZE].done= 1;
-
-    if (fDiag==sDiag) dist=sDist;
-    else dist = -1;
-
-    while (dist < lenA) { // Main loop.
- 
-      for (int i=cost-MODSIZE,j=fDiag; i>=abs(j); i--,j++) {
-	diagArray[j+offset][i%MODSIZE].done = 0;
-	horzArray[j+offset][i%MODSIZE].done = 0;
-	vertArray[j+offset][i%MODSIZE].done = 0;
-      }
-      for (int i=cost-MODSIZE,j=fDiag; i>=abs(j); i--,j--) {
-	diagArray[j+offset][i%MODSIZE].done = 0;
-	horzArray[j+offset][i%MODSIZE].done = 0;
-	vertArray[j+offset][i%MODSIZE].done = 0;
-      }
+    for (int k=0; k<numFronts; k++)
+      wf[k].cost = -1;
+    cost = 0;
+    firstState = state;
+    firstCost = -1;
 
-      int v1 = Ukk(sDiag, sCost, diag, fDiag, cost);
-      int v2 = Ukk(sDiag, sCost, horz, fDiag, cost);
-      int v3 = Ukk(sDiag, sCost, vert, fDiag, cost);
-      dist = MAX3(v1,v2,v3);
-      
-      cost++;
-    };
-    cost--;
-
-    if (dist>lenA) {
-      fprintf(stderr,"ERROR: Missed lenA.  Final dist=%d  lenA=%d\n",dist,lenA);
-      exit(-1);
+    // Cost 0 is the initial matchings of A and B. (For entry 0,0
+    // in the Ukkonen matrix.
+    struct wavefront *w = slot(0);
+    w->cost = 0;
+    if (firstStep && state!=diag) {
+      w->lo = 0;		// Nothing until the first step
+      w->hi = -1;
+      firstCost = Cost::a+Cost::b;
+      return;
     }
+    w->lo = w->hi = 0;
+    reserve(w, 1);
+    w->far[diag][0] = extend(0, 0);
+    w->far[horz][0] = w->far[vert][0] = BIG_NEGATIVE;
+    if (state!=diag)
+      w->far[state][0] = 0;
+  }
 
-
-    return cost;
+  // extendTo() - work out the wavefronts up to cost c
+  void extendTo(int c)
+  {
+    while (cost < c)
+      nextFront(++cost);
   }
 
-public:
-  // editCost() - Calculate edit distance and display the alignment between
-  //              two strings A and B.
+  // editCost() - Calculate edit distance between two strings A and B.
   int editCost(char strA[], char strB[])
   {
-    int cost;
     int finalDiag;
-    int sDist;
-    int maxEditdist;
 
-    A = strA;
-    B = strB;
-    lenA = strlen(A);
-    lenB = strlen(B);
+    start(strA, strlen(strA), strB, strlen(strB), diag, 0);
     finalDiag = lenA-lenB;
 
-    maxEditdist = (lenA>lenB) ? lenA : lenB; // Maximum possible edit distance.
-    maxEditdist *= MODSIZE;	// This is an upper bound (I think)
-
-    offset = (maxEditdist-finalDiag)/2; // Offset to allow for -ve diagonals
-    
-    // Now allocate storage. Largest possible edit distance by 3 columns needed
-    diagArray = new struct ukkElem[maxEditdist+1][MODSIZE];
-    horzArray = new struct ukkElem[maxEditdist+1][MODSIZE];
-    vertArray = new struct ukkElem[maxEditdist+1][MODSIZE];
-    arraySize = maxEditdist+1;
-    
-    // Calculate and display the initial matchings of A and B. (For entry 0,0
-    // in the Ukkonen matrix.
-    for (sDist=0; A[sDist] && A[sDist]==B[sDist]; sDist++) ;
-//      printf("<%c,%c> ",A[sDist],B[sDist]);
-
-    cost = doUkk(0, 0, sDist, finalDiag);
+    while (get(front(cost), diag, finalDiag) < lenA)
+      nextFront(++cost);
     
     return cost;
   }
 };
-
-
-
-
-
-